@@ -0,0 +1,63 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+require 'opcua_client'
+
+# This example measures sustained notifications per second for different
+# numbers of outstanding publish requests and monitored item queue sizes.
+# A writer process changes the double variables of tools/server as fast as it
+# can while the subscribing client counts what it receives.
+#
+# Start the server first: cd tools/server && make && ./server
+
+# Configuration
+ENDPOINT_URL = 'opc.tcp://127.0.0.1:4840'
+NAMESPACE_ID = 5
+NODES = %w[double_zero double_pi double_negative double_large].freeze
+PUBLISHING_INTERVAL = 10 # ms
+DURATION = 5 # seconds per run
+RUNS = [[1, 1], [2, 1], [5, 1], [10, 1], [10, 10], [20, 10]].freeze # [outstanding, queue_size]
+
+writer = fork do
+  client = OPCUAClient::Client.new
+  client.connect(ENDPOINT_URL)
+  value = 0.0
+  loop do
+    value += 1
+    client.multi_write_double(NAMESPACE_ID, NODES, Array.new(NODES.size, value))
+  end
+ensure
+  client&.disconnect
+end
+
+def measure(outstanding, queue_size)
+  client = OPCUAClient::Client.new
+  client.outstanding_publish_requests = outstanding
+  client.queue_size = queue_size
+  client.connect(ENDPOINT_URL)
+
+  notifications = 0
+  subscription_id = client.create_subscription(publishing_interval: PUBLISHING_INTERVAL)[:id]
+  client.add_monitored_items(subscription_id, NODES.map { |name| [NAMESPACE_ID, name] }, sampling_interval: 0) do |*|
+    notifications += 1
+  end
+
+  started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  client.run_mon_cycle while Process.clock_gettime(Process::CLOCK_MONOTONIC) - started < DURATION
+  notifications.fdiv(Process.clock_gettime(Process::CLOCK_MONOTONIC) - started)
+ensure
+  client.disconnect
+end
+
+puts "Publishing interval #{PUBLISHING_INTERVAL} ms, #{NODES.size} items, #{DURATION} s per run"
+puts '=' * 60
+puts format('%-12s %-12s %s', 'outstanding', 'queue_size', 'notifications/s')
+
+begin
+  RUNS.each do |outstanding, queue_size|
+    puts format('%-12d %-12d %.0f', outstanding, queue_size, measure(outstanding, queue_size))
+  end
+ensure
+  Process.kill('TERM', writer)
+  Process.wait(writer)
+end
@@ -5,6 +5,9 @@ have_library('mbedtls') or abort "mbedtls library not found"
 have_library('mbedx509') or abort "mbedx509 library not found"
 have_library('mbedcrypto') or abort "mbedcrypto library not found"
 
+# IO::Buffer (Ruby >= 3.2) can be passed to the packed array writers
+have_func('rb_io_buffer_get_bytes_for_reading', 'ruby/io/buffer.h')
+
 # Suppress warnings from open62541.c (vendored library)
 # These warnings are in the upstream open62541 library code
 $CFLAGS << ' -Wno-discarded-qualifiers'
@@ -1,5 +1,9 @@
 #include <ruby.h>
 #include <ruby/encoding.h>
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_READING
+#include <ruby/io/buffer.h>
+#endif
+#include <math.h>
 #include "open62541.h"
 
 VALUE cClient;
@@ -10,43 +14,638 @@ struct UninitializedClient {
     UA_Client *client;
 };
 
+struct RequestArenaStats {
+    UA_UInt64 requests;
+    UA_UInt64 allocations;
+    UA_UInt64 blocks;
+    UA_UInt64 bytes;
+};
+
+struct NodeMap {
+    UA_NodeId *keys;
+    size_t count;
+    size_t capacity;
+    size_t *slots;
+    size_t slotCount;
+};
+
+/* A timer flush sent to the server, then answered and waiting for Ruby */
+struct WriteFlushInFlight {
+    UA_WriteValue *writes;
+    size_t count;
+    size_t skipped; /* writes left out because the shadow had them */
+    UA_WriteResponse response;
+    struct WriteFlushInFlight *next;
+};
+
+struct WriteQueue {
+    struct NodeMap index;
+    UA_DataValue *values;
+    size_t capacity;
+    struct WriteFlushInFlight *flushed;
+    UA_UInt64 timerId;
+    UA_UInt64 enqueued;
+    UA_UInt64 coalesced;
+    UA_UInt64 flushes;
+};
+
+struct WriteShadow {
+    UA_Boolean enabled;
+    UA_Double deadband;
+    struct NodeMap index;
+    UA_Variant *values;
+    size_t capacity;
+    UA_UInt64 hits;
+    UA_UInt64 misses;
+};
+
+/* How timestamps are handed to Ruby */
+enum TimestampFormat {
+    TIMESTAMPS_TIME,
+    TIMESTAMPS_EPOCH_NS,
+    TIMESTAMPS_FLOAT
+};
+
+struct NotificationBatch {
+    size_t count;
+    size_t capacity;
+    UA_UInt32 *subscriptionIds;
+    UA_UInt32 *monitoredItemIds;
+    UA_Byte *timestampFormats;
+    UA_DataValue *values;
+    UA_DateTime *received;
+    UA_UInt64 dropped;
+};
+
+enum OverflowPolicy {
+    OVERFLOW_DROP_OLDEST,
+    OVERFLOW_DROP_NEWEST,
+    OVERFLOW_COALESCE
+};
+
+struct NotificationRing {
+    UA_Boolean enabled;
+    enum OverflowPolicy policy;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    UA_UInt32 *subscriptionIds;
+    UA_UInt32 *monitoredItemIds;
+    UA_Byte *timestampFormats;
+    struct MonitoredItemContext **items;
+    UA_DataValue *values;
+    UA_DateTime *received;
+    size_t highWater;
+    UA_UInt64 pushed;
+    UA_UInt64 dropped;
+    UA_UInt64 coalesced;
+};
+
+#define LATENCY_BUCKETS 32
+
+enum LatencyStage {
+    LATENCY_SOURCE_TO_SERVER,
+    LATENCY_SERVER_TO_RECEIPT,
+    LATENCY_RECEIPT_TO_CALLBACK,
+    LATENCY_SOURCE_TO_CALLBACK,
+    LATENCY_STAGES
+};
+
+struct LatencyHistogram {
+    UA_UInt64 count;
+    UA_UInt64 negative;
+    UA_DateTime sum;
+    UA_DateTime max;
+    UA_UInt64 buckets[LATENCY_BUCKETS];
+};
+
+struct LatencyTracking {
+    UA_Boolean enabled;
+    UA_Boolean offsetKnown;
+    UA_DateTime clockOffset;
+    struct LatencyHistogram stages[LATENCY_STAGES];
+};
+
+struct StalenessEntry {
+    struct MonitoredItemContext *item;
+    UA_UInt32 subscriptionId;
+    UA_UInt32 monitoredItemId;
+    UA_DateTime lastUpdate;
+    UA_DateTime maxSilence;
+};
+
+struct Staleness {
+    struct StalenessEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t *index; /* by subscription and item id: entry slot + 1, 0 if empty */
+    size_t indexSize; /* twice the capacity, a power of two */
+};
+
+enum ConnectionState {
+    CONNECTION_DISCONNECTED,
+    CONNECTION_CONNECTED,
+    CONNECTION_RECONNECTING
+};
+
+struct Reconnect {
+    UA_Boolean enabled;
+    UA_Boolean wanted; /* connected by the application and not disconnected since */
+    enum ConnectionState state;
+    UA_Double initialDelay; /* seconds */
+    UA_Double maxDelay;
+    UA_Double multiplier;
+    UA_Double jitter; /* fraction of the delay */
+    UA_Double delay;
+    UA_UInt32 attempt;
+    UA_DateTime nextAttempt; /* monotonic */
+    UA_Boolean connecting; /* an attempt is in progress */
+    UA_DateTime attemptDeadline; /* monotonic */
+    UA_NodeId sessionToken;
+};
+
+#define HEALTH_WINDOW 128
+
+struct HealthMonitor {
+    UA_Boolean enabled;
+    UA_UInt64 callbackId;
+    UA_DateTime interval;
+    UA_DateTime lastActivity; /* monotonic, of the last response from the server */
+    UA_DateTime rttThreshold; /* 0 disables */
+    UA_UInt32 failureThreshold;
+    UA_Boolean probing;
+    UA_DateTime sent; /* monotonic */
+    UA_Boolean known; /* at least one probe answered or failed */
+    UA_Boolean alive;
+    UA_Boolean slow;
+    UA_UInt32 consecutiveFailures;
+    UA_UInt64 probes;
+    UA_UInt64 failures;
+    UA_StatusCode lastStatus;
+    UA_DateTime lastRtt;
+    UA_DateTime samples[HEALTH_WINDOW];
+    size_t sampleCount;
+    size_t sampleNext;
+    UA_Boolean reportedAlive;
+    UA_Boolean reportedSlow;
+};
+
+struct TriggerLink {
+    UA_UInt32 triggeringId;
+    UA_UInt32 triggeredId;
+};
+
+struct SubscriptionRecord {
+    UA_UInt32 subscriptionId;
+    UA_Boolean lost;
+    UA_CreateSubscriptionRequest request;
+    void *context;
+    size_t itemCount;
+    size_t itemCapacity;
+    UA_MonitoredItemCreateRequest *items;
+    UA_UInt32 *itemIds;
+    VALUE *handlers;
+    VALUE *tags;
+    size_t linkCount;
+    size_t linkCapacity;
+    struct TriggerLink *links;
+    struct SubscriptionRecord *next;
+};
+
+struct SubscriptionStats {
+    UA_UInt32 subscriptionId;
+    UA_Double publishingInterval;
+    UA_UInt32 keepAliveCount;
+    UA_UInt32 lifetimeCount;
+    UA_DateTime created;
+    UA_DateTime lastNotification;
+    UA_DateTime lastScrape;
+    UA_UInt64 notifications;
+    UA_UInt64 scrapeNotifications;
+    UA_UInt64 events;
+    UA_UInt64 overflows;
+    UA_UInt64 statusChanges;
+    UA_UInt64 inactivity;
+    UA_StatusCode lastStatus;
+};
+
+struct SubscriptionStatsTable {
+    struct SubscriptionStats *entries;
+    size_t count;
+    size_t capacity;
+    size_t lastHit;
+};
+
+struct OperationLimits {
+    UA_Boolean read;
+    UA_UInt32 maxNodesPerWrite;
+    UA_UInt32 maxMonitoredItemsPerCall;
+    UA_UInt32 maxMonitoredItemsPerSubscription;
+};
+
 struct OpcuaClientContext {
     VALUE rubyClientInstance;
+    UA_Boolean deleting;
+    struct OperationLimits operationLimits;
+    size_t writeChunkSize;
+    struct RequestArenaStats arenaStats;
+    struct WriteQueue writeQueue;
+    struct WriteShadow writeShadow;
+    UA_Boolean batchEnabled;
+    struct NotificationBatch notificationBatch;
+    enum TimestampFormat timestampFormat;
+    struct MonitoredItemContext *monitoredItems;
+    struct NotificationRing notificationRing;
+    UA_Boolean preserveSubscriptions;
+    UA_Boolean recoveryPending;
+    struct SubscriptionRecord *subscriptionRecords;
+    struct SubscriptionStatsTable subscriptionStats;
+    UA_UInt32 queueSize;
+    struct LatencyTracking latency;
+    struct Staleness staleness;
+    struct Reconnect reconnect;
+    struct HealthMonitor health;
+};
+
+/* Item contexts are linked into the client context so their Ruby objects
+ * can be marked while open62541 owns the items */
+struct MonitoredItemContext {
+    UA_NodeId nodeId;
+    VALUE handler;
+    VALUE tag;
+    size_t ringSlot; /* slot + 1 of the item's newest entry in the notification ring, 0 if none */
+    size_t staleSlot; /* slot + 1 of the item's staleness entry, 0 if not tracked */
+    struct MonitoredItemContext *prev;
+    struct MonitoredItemContext *next;
 };
 
+static void writeShadow_refresh(struct WriteShadow *shadow, const UA_NodeId *nodeId, const UA_DataValue *value);
+static void recoverSubscriptions(VALUE self, UA_Client *client);
+static void notificationBatch_append(struct NotificationBatch *batch, UA_UInt32 subId, UA_UInt32 monId,
+        enum TimestampFormat format, UA_DataValue *value, UA_DateTime received);
+static void notificationRing_push(struct NotificationRing *ring, UA_UInt32 subId, UA_UInt32 monId,
+        struct MonitoredItemContext *item, enum TimestampFormat format, UA_DataValue *value, UA_DateTime received);
+
+/* UA_DateTime counts 100ns ticks since 1601, converted without losing precision */
 static VALUE toRubyTime(UA_DateTime raw_date) {
-    UA_DateTimeStruct dts = UA_DateTime_toStruct(raw_date);
-    VALUE year = UINT2NUM(dts.year);
-    VALUE month = UINT2NUM(dts.month);
-    VALUE day = UINT2NUM(dts.day);
-    VALUE hour = UINT2NUM(dts.hour);
-    VALUE min = UINT2NUM(dts.min);
-    VALUE sec = UINT2NUM(dts.sec);
-    VALUE millis = UINT2NUM(dts.milliSec);
-    VALUE cDate = rb_const_get(rb_cObject, rb_intern("Time"));
-    VALUE rb_date = rb_funcall(cDate, rb_intern("gm"), 7, year, month, day, hour, min, sec, millis);
-    return rb_date;
+    UA_DateTime ticks = raw_date - UA_DATETIME_UNIX_EPOCH;
+    UA_DateTime sec = ticks / UA_DATETIME_SEC;
+    UA_DateTime rest = ticks % UA_DATETIME_SEC;
+    if (rest < 0) {
+        sec--;
+        rest += UA_DATETIME_SEC;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = (time_t)sec;
+    ts.tv_nsec = (long)rest * 100;
+
+    /* INT_MAX - 1 makes a UTC Time */
+    return rb_time_timespec_new(&ts, INT_MAX - 1);
 }
 
-static void handler_dataChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
-		UA_UInt32 monId, void *monContext, UA_DataValue *value) {
+static VALUE toRubyTimestamp(UA_DateTime raw_date, enum TimestampFormat format) {
+    switch (format) {
+    case TIMESTAMPS_EPOCH_NS: return LL2NUM((raw_date - UA_DATETIME_UNIX_EPOCH) * 100);
+    case TIMESTAMPS_FLOAT: return DBL2NUM((UA_Double)(raw_date - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_SEC);
+    default: return toRubyTime(raw_date);
+    }
+}
 
-    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
-    VALUE self = ctx->rubyClientInstance;
-    VALUE callback = rb_ivar_get(self, rb_intern("@callback_after_data_changed"));
+static enum TimestampFormat timestampFormatFromSymbol(VALUE v_format) {
+    Check_Type(v_format, T_SYMBOL);
+    ID format = SYM2ID(v_format);
 
-    if (NIL_P(callback)) {
+    if (format == rb_intern("time")) {
+        return TIMESTAMPS_TIME;
+    } else if (format == rb_intern("epoch_ns")) {
+        return TIMESTAMPS_EPOCH_NS;
+    } else if (format == rb_intern("float")) {
+        return TIMESTAMPS_FLOAT;
+    }
+
+    rb_raise(cError, "Unsupported timestamp format");
+}
+
+static VALUE timestampFormatToSymbol(enum TimestampFormat format) {
+    switch (format) {
+    case TIMESTAMPS_EPOCH_NS: return ID2SYM(rb_intern("epoch_ns"));
+    case TIMESTAMPS_FLOAT: return ID2SYM(rb_intern("float"));
+    default: return ID2SYM(rb_intern("time"));
+    }
+}
+
+/* Subscription contexts point into this table to select their format */
+static const enum TimestampFormat subscriptionTimestampFormats[] = {
+    TIMESTAMPS_TIME, TIMESTAMPS_EPOCH_NS, TIMESTAMPS_FLOAT
+};
+
+/* Ruby value of a scalar variant, nil for unsupported types */
+static VALUE variantScalarToRuby(const UA_Variant *value, enum TimestampFormat format) {
+    if (!UA_Variant_isScalar(value) || !value->type) {
+        return Qnil;
+    }
+
+    switch (value->type->typeKind) {
+    case UA_DATATYPEKIND_BOOLEAN: return *(UA_Boolean*)value->data ? Qtrue : Qfalse;
+    case UA_DATATYPEKIND_SBYTE: return INT2FIX(*(UA_SByte*)value->data);
+    case UA_DATATYPEKIND_BYTE: return INT2FIX(*(UA_Byte*)value->data);
+    case UA_DATATYPEKIND_INT16: return INT2FIX(*(UA_Int16*)value->data);
+    case UA_DATATYPEKIND_UINT16: return INT2FIX(*(UA_UInt16*)value->data);
+    case UA_DATATYPEKIND_INT32: return INT2NUM(*(UA_Int32*)value->data);
+    case UA_DATATYPEKIND_UINT32: return UINT2NUM(*(UA_UInt32*)value->data);
+    case UA_DATATYPEKIND_INT64: return LL2NUM(*(UA_Int64*)value->data);
+    case UA_DATATYPEKIND_UINT64: return ULL2NUM(*(UA_UInt64*)value->data);
+    case UA_DATATYPEKIND_FLOAT: return DBL2NUM(*(UA_Float*)value->data);
+    case UA_DATATYPEKIND_DOUBLE: return DBL2NUM(*(UA_Double*)value->data);
+    case UA_DATATYPEKIND_DATETIME: return toRubyTimestamp(*(UA_DateTime*)value->data, format);
+    case UA_DATATYPEKIND_STRING: {
+        UA_String *str = (UA_String*)value->data;
+        return rb_enc_str_new((char*)str->data, str->length, rb_utf8_encoding());
+    }
+    default: return Qnil;
+    }
+}
+
+/* Latency histograms
+ *
+ * With measure_latency enabled, every data change notification adds its
+ * gaps source -> server timestamp, server timestamp -> receipt by the client,
+ * receipt -> Ruby callback entry and source -> callback entry to log2
+ * histograms. Bucket i counts gaps below 2^i microseconds. Gaps involving
+ * the local clock are corrected by the server clock offset, once estimated. */
+
+static void latencyHistogram_add(struct LatencyHistogram *histogram, UA_DateTime gap) {
+    if (gap < 0) {
+        histogram->negative++;
+        return;
+    }
+
+    UA_UInt64 micros = (UA_UInt64)gap / UA_DATETIME_USEC;
+    size_t bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && micros >= (1ULL << bucket)) {
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum += gap;
+    if (gap > histogram->max) {
+        histogram->max = gap;
+    }
+}
+
+/* Gaps known when the notification arrives */
+static void latency_received(struct LatencyTracking *latency, const UA_DataValue *value, UA_DateTime received) {
+    if (value->hasSourceTimestamp && value->hasServerTimestamp) {
+        latencyHistogram_add(&latency->stages[LATENCY_SOURCE_TO_SERVER], value->serverTimestamp - value->sourceTimestamp);
+    }
+    if (value->hasServerTimestamp) {
+        latencyHistogram_add(&latency->stages[LATENCY_SERVER_TO_RECEIPT],
+                             received + latency->clockOffset - value->serverTimestamp);
+    }
+}
+
+/* Gaps known when Ruby is about to be called */
+static void latency_delivered(struct LatencyTracking *latency, const UA_DataValue *value, UA_DateTime received,
+        UA_DateTime now) {
+    latencyHistogram_add(&latency->stages[LATENCY_RECEIPT_TO_CALLBACK], now - received);
+    if (value->hasSourceTimestamp) {
+        latencyHistogram_add(&latency->stages[LATENCY_SOURCE_TO_CALLBACK],
+                             now + latency->clockOffset - value->sourceTimestamp);
+    }
+}
+
+/* Subscription statistics
+ *
+ * Counters kept per subscription while notifications are dispatched, read by
+ * subscription_stats. Notifications arrive grouped by subscription, so the
+ * last lookup is remembered. Publish responses themselves (round trip,
+ * keep-alives, sequence numbers) stay inside open62541 and are not counted. */
+
+static struct SubscriptionStats *subscriptionStats_find(struct OpcuaClientContext *ctx, UA_UInt32 subscriptionId) {
+    struct SubscriptionStatsTable *table = &ctx->subscriptionStats;
+
+    if (table->lastHit < table->count && table->entries[table->lastHit].subscriptionId == subscriptionId) {
+        return &table->entries[table->lastHit];
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        if (table->entries[i].subscriptionId == subscriptionId) {
+            table->lastHit = i;
+            return &table->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void subscriptionStats_add(struct OpcuaClientContext *ctx, const UA_CreateSubscriptionResponse *response) {
+    struct SubscriptionStatsTable *table = &ctx->subscriptionStats;
+
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 8;
+        struct SubscriptionStats *entries = UA_realloc(table->entries, capacity * sizeof(struct SubscriptionStats));
+        if (!entries) {
+            return;
+        }
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+
+    struct SubscriptionStats *stats = &table->entries[table->count++];
+    *stats = (const struct SubscriptionStats){ 0 };
+    stats->subscriptionId = response->subscriptionId;
+    stats->publishingInterval = response->revisedPublishingInterval;
+    stats->keepAliveCount = response->revisedMaxKeepAliveCount;
+    stats->lifetimeCount = response->revisedLifetimeCount;
+    stats->created = UA_DateTime_nowMonotonic();
+    stats->lastScrape = stats->created;
+}
+
+static void subscriptionStats_remove(struct OpcuaClientContext *ctx, UA_UInt32 subscriptionId) {
+    struct SubscriptionStats *stats = subscriptionStats_find(ctx, subscriptionId);
+    if (stats) {
+        struct SubscriptionStatsTable *table = &ctx->subscriptionStats;
+        *stats = table->entries[--table->count];
+    }
+}
+
+static void subscriptionStats_free(struct OpcuaClientContext *ctx) {
+    UA_free(ctx->subscriptionStats.entries);
+    ctx->subscriptionStats = (const struct SubscriptionStatsTable){ 0 };
+}
+
+/* Staleness
+ *
+ * Every reporting data change item gets an entry in a compact array with the
+ * time of its last notification and the longest silence expected from it:
+ * its sampling interval plus the subscription's keep-alive period, after
+ * which even a quiet item would have been confirmed by a keep-alive of a
+ * live subscription. stale_items scans the array without touching Ruby
+ * objects except for the items it reports. An open addressing index finds
+ * the entry of a subscription and item id, for ModifyMonitoredItems. Room
+ * for the entries and the index is reserved before the items are created,
+ * so tracking a created item cannot fail. */
+
+static size_t staleness_hash(UA_UInt32 subId, UA_UInt32 monId) {
+    return (size_t)((((UA_UInt64)subId << 32 | monId) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/* Index cell of the entry for the ids, or the empty cell where it would go */
+static size_t staleness_cell(const struct Staleness *staleness, UA_UInt32 subId, UA_UInt32 monId) {
+    size_t mask = staleness->indexSize - 1;
+    size_t cell = staleness_hash(subId, monId) & mask;
+
+    while (staleness->index[cell]) {
+        const struct StalenessEntry *entry = &staleness->entries[staleness->index[cell] - 1];
+        if (entry->subscriptionId == subId && entry->monitoredItemId == monId) {
+            break;
+        }
+        cell = (cell + 1) & mask;
+    }
+
+    return cell;
+}
+
+/* Empties a cell, moving later entries of the probe run back into the hole */
+static void staleness_unindex(struct Staleness *staleness, size_t cell) {
+    size_t mask = staleness->indexSize - 1;
+    staleness->index[cell] = 0;
+
+    for (size_t next = (cell + 1) & mask; staleness->index[next]; next = (next + 1) & mask) {
+        const struct StalenessEntry *entry = &staleness->entries[staleness->index[next] - 1];
+        size_t home = staleness_hash(entry->subscriptionId, entry->monitoredItemId) & mask;
+        if (((next - home) & mask) >= ((next - cell) & mask)) {
+            staleness->index[cell] = staleness->index[next];
+            staleness->index[next] = 0;
+            cell = next;
+        }
+    }
+}
+
+static UA_Boolean staleness_reserve(struct OpcuaClientContext *ctx, size_t count) {
+    struct Staleness *staleness = &ctx->staleness;
+    if (staleness->capacity - staleness->count >= count) {
+        return true;
+    }
+
+    size_t capacity = staleness->capacity ? staleness->capacity : 64;
+    while (capacity - staleness->count < count) {
+        capacity *= 2;
+    }
+
+    size_t *index = UA_calloc(capacity * 2, sizeof(size_t));
+    if (!index) {
+        return false;
+    }
+    struct StalenessEntry *entries = UA_realloc(staleness->entries, capacity * sizeof(struct StalenessEntry));
+    if (!entries) {
+        UA_free(index);
+        return false;
+    }
+
+    UA_free(staleness->index);
+    staleness->entries = entries;
+    staleness->capacity = capacity;
+    staleness->index = index;
+    staleness->indexSize = capacity * 2;
+    for (size_t i = 0; i < staleness->count; i++) {
+        const struct StalenessEntry *entry = &staleness->entries[i];
+        staleness->index[staleness_cell(staleness, entry->subscriptionId, entry->monitoredItemId)] = i + 1;
+    }
+    return true;
+}
+
+static UA_DateTime staleness_maxSilence(struct OpcuaClientContext *ctx, UA_UInt32 subId, UA_Double samplingInterval) {
+    /* Servers revise -1 to the publishing interval, some report it as is */
+    UA_Double silence = samplingInterval > 0 ? samplingInterval : 0;
+    struct SubscriptionStats *stats = subscriptionStats_find(ctx, subId);
+    if (stats) {
+        silence += stats->publishingInterval * (stats->keepAliveCount + 1);
+    }
+    return (UA_DateTime)(silence * UA_DATETIME_MSEC);
+}
+
+/* Needs room from staleness_reserve */
+static void staleness_track(struct OpcuaClientContext *ctx, struct MonitoredItemContext *item, UA_UInt32 subId,
+        UA_UInt32 monId, UA_Double samplingInterval) {
+    struct Staleness *staleness = &ctx->staleness;
+    if (staleness->count == staleness->capacity) {
+        return;
+    }
+
+    struct StalenessEntry *entry = &staleness->entries[staleness->count++];
+    entry->item = item;
+    entry->subscriptionId = subId;
+    entry->monitoredItemId = monId;
+    entry->lastUpdate = UA_DateTime_nowMonotonic();
+    entry->maxSilence = staleness_maxSilence(ctx, subId, samplingInterval);
+    item->staleSlot = staleness->count;
+    staleness->index[staleness_cell(staleness, subId, monId)] = staleness->count;
+}
+
+static void staleness_untrack(struct OpcuaClientContext *ctx, struct MonitoredItemContext *item) {
+    struct Staleness *staleness = &ctx->staleness;
+    size_t slot = item->staleSlot - 1;
+    const struct StalenessEntry *entry = &staleness->entries[slot];
+    staleness_unindex(staleness, staleness_cell(staleness, entry->subscriptionId, entry->monitoredItemId));
+
+    staleness->entries[slot] = staleness->entries[--staleness->count];
+    if (slot < staleness->count) {
+        entry = &staleness->entries[slot];
+        entry->item->staleSlot = slot + 1;
+        staleness->index[staleness_cell(staleness, entry->subscriptionId, entry->monitoredItemId)] = slot + 1;
+    }
+    item->staleSlot = 0;
+}
+
+/* Follows a new sampling interval from ModifyMonitoredItems; the item's
+ * silence so far still counts */
+static void staleness_revise(struct OpcuaClientContext *ctx, UA_UInt32 subId, UA_UInt32 monId,
+        UA_Double samplingInterval) {
+    struct Staleness *staleness = &ctx->staleness;
+    if (staleness->count == 0) {
         return;
     }
 
+    size_t slot = staleness->index[staleness_cell(staleness, subId, monId)];
+    if (slot) {
+        staleness->entries[slot - 1].maxSilence = staleness_maxSilence(ctx, subId, samplingInterval);
+    }
+}
+
+/* A response arrived from the server outside of the health probes, which
+ * shows the session alive just as well */
+static void health_activity(struct HealthMonitor *health, UA_DateTime now) {
+    health->lastActivity = now;
+    if (health->enabled && health->consecutiveFailures) {
+        health->consecutiveFailures = 0;
+        health->alive = true;
+    }
+}
+
+static void
+subscriptionStatusChanged(UA_Client *client, UA_UInt32 subId, void *subContext, UA_StatusChangeNotification *notification) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    health_activity(&ctx->health, UA_DateTime_nowMonotonic());
+
+    struct SubscriptionStats *stats = subscriptionStats_find(ctx, subId);
+    if (stats) {
+        stats->statusChanges++;
+        stats->lastStatus = notification->status;
+    }
+}
+
+static void dataChangedToRuby(VALUE callback, UA_UInt32 subId, UA_UInt32 monId,
+        enum TimestampFormat format, const UA_DataValue *value) {
     VALUE v_serverTime = Qnil;
     if (value->hasServerTimestamp) {
-        v_serverTime = toRubyTime(value->serverTimestamp);
+        v_serverTime = toRubyTimestamp(value->serverTimestamp, format);
     }
 
     VALUE v_sourceTime = Qnil;
     if (value->hasSourceTimestamp) {
-        v_sourceTime = toRubyTime(value->sourceTimestamp);
+        v_sourceTime = toRubyTimestamp(value->sourceTimestamp, format);
     }
 
     VALUE params = rb_ary_new();
@@ -55,37 +654,105 @@ static void handler_dataChanged(UA_Client *client, UA_UInt32 subId, void *subCon
     rb_ary_push(params, v_serverTime);
     rb_ary_push(params, v_sourceTime);
 
-    VALUE v_newValue = Qnil;
-
-    if(UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_DATETIME])) {
-        UA_DateTime raw_date = *(UA_DateTime *) value->value.data;
-        v_newValue = toRubyTime(raw_date);
-    } else if (UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_INT32])) {
-        UA_Int32 number = *(UA_Int32 *) value->value.data;
-        v_newValue = INT2NUM(number);
-    } else if (UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_INT16])) {
-        UA_Int16 number = *(UA_Int16 *) value->value.data;
-        v_newValue = INT2NUM(number);
-    } else if (UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_BOOLEAN])) {
-        UA_Boolean b = *(UA_Boolean *) value->value.data;
-        v_newValue = b ? Qtrue : Qfalse;
-    } else if (UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_FLOAT])) {
-        UA_Float dbl = *(UA_Float *) value->value.data;
-        v_newValue = DBL2NUM(dbl);
-    }
+    VALUE v_newValue = variantScalarToRuby(&value->value, format);
 
     rb_ary_push(params, v_newValue);
     rb_proc_call(callback, params);
 }
 
+static void handler_dataChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
+		UA_UInt32 monId, void *monContext, UA_DataValue *value) {
+
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct MonitoredItemContext *item = monContext;
+    enum TimestampFormat format = subContext ? *(const enum TimestampFormat*)subContext : ctx->timestampFormat;
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    health_activity(&ctx->health, now);
+    if (item && item->staleSlot) {
+        ctx->staleness.entries[item->staleSlot - 1].lastUpdate = now;
+    }
+
+    struct SubscriptionStats *stats = subscriptionStats_find(ctx, subId);
+    if (stats) {
+        stats->notifications++;
+        stats->lastNotification = now;
+        if (value->hasStatus && (value->status & UA_STATUSCODE_INFOBITS_OVERFLOW)) {
+            stats->overflows++;
+        }
+    }
+
+    UA_DateTime received = 0;
+    if (ctx->latency.enabled) {
+        received = UA_DateTime_now();
+        latency_received(&ctx->latency, value, received);
+    }
+
+    if (item) {
+        writeShadow_refresh(&ctx->writeShadow, &item->nodeId, value);
+    }
+
+    if (ctx->notificationRing.enabled) {
+        notificationRing_push(&ctx->notificationRing, subId, monId, item, format, value, received);
+        return;
+    }
+
+    /* The batch takes over the value and replaces the per-value callbacks */
+    if (ctx->batchEnabled) {
+        notificationBatch_append(&ctx->notificationBatch, subId, monId, format, value, received);
+        return;
+    }
+
+    if (item && !NIL_P(item->handler)) {
+        if (ctx->latency.enabled) {
+            latency_delivered(&ctx->latency, value, received, UA_DateTime_now());
+        }
+
+        /* Items with their own handler skip the client callback */
+        VALUE params = rb_ary_new();
+        rb_ary_push(params, value->hasValue ? variantScalarToRuby(&value->value, format) : Qnil);
+        rb_ary_push(params, value->hasSourceTimestamp ? toRubyTimestamp(value->sourceTimestamp, format) : Qnil);
+        rb_ary_push(params, value->hasServerTimestamp ? toRubyTimestamp(value->serverTimestamp, format) : Qnil);
+        rb_ary_push(params, item->tag);
+        rb_proc_call(item->handler, params);
+    } else {
+        static ID id_callback;
+        if (!id_callback) {
+            id_callback = rb_intern("@callback_after_data_changed");
+        }
+
+        VALUE callback = rb_ivar_get(ctx->rubyClientInstance, id_callback);
+        if (!NIL_P(callback)) {
+            if (ctx->latency.enabled) {
+                latency_delivered(&ctx->latency, value, received, UA_DateTime_now());
+            }
+            dataChangedToRuby(callback, subId, monId, format, value);
+        }
+    }
+}
+
 static void
 deleteSubscriptionCallback(UA_Client *client, UA_UInt32 subscriptionId, void *subscriptionContext) {
     // printf("Subscription Id %u was deleted\n", subscriptionId);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    subscriptionStats_remove(ctx, subscriptionId);
+
+    /* Still recorded, so it was not deleted on request: recreate it later */
+    for (struct SubscriptionRecord *record = ctx->subscriptionRecords; record; record = record->next) {
+        if (!record->lost && record->subscriptionId == subscriptionId) {
+            record->lost = true;
+            ctx->recoveryPending = true;
+        }
+    }
 }
 
 static void
 subscriptionInactivityCallback(UA_Client *client, UA_UInt32 subscriptionId, void *subContext) {
     // printf("Inactivity for subscription %u", subscriptionId);
+    struct SubscriptionStats *stats = subscriptionStats_find(UA_Client_getContext(client), subscriptionId);
+    if (stats) {
+        stats->inactivity++;
+    }
 }
 
 static void
@@ -97,6 +764,8 @@ stateCallback (UA_Client *client, UA_SecureChannelState channelState,
     if(sessionState == UA_SESSIONSTATE_ACTIVATED) {
         /* A new session was created! */
         // printf("%s\n", "A new session was created!");
+        ctx->operationLimits.read = false;
+
         VALUE self = ctx->rubyClientInstance;
 
         VALUE callback = rb_ivar_get(self, rb_intern("@callback_after_session_created"));
@@ -132,592 +801,4087 @@ static VALUE raise_ua_status_error(UA_StatusCode status) {
     return Qnil;
 }
 
-static void UA_Client_free(void *self) {
-    // printf("free client\n");
-    struct UninitializedClient *uclient = self;
+/* Optional keywords of an options Hash (or nil), looked up by name. Unknown
+ * keys raise ArgumentError, missing ones are left Qundef, and the caller's
+ * Hash is not modified. */
+#define KEYWORDS_MAX 8
 
-    if (uclient->client) {
-        struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
-        xfree(ctx);
-        UA_Client_delete(uclient->client);
+static void keywordsFromRuby(VALUE v_options, const char *const *names, int count, VALUE *values) {
+    for (int i = 0; i < count; i++) {
+        values[i] = Qundef;
+    }
+    if (NIL_P(v_options)) {
+        return;
     }
 
-    xfree(self);
+    ID ids[KEYWORDS_MAX];
+    for (int i = 0; i < count; i++) {
+        ids[i] = rb_intern(names[i]);
+    }
+
+    /* rb_get_kwargs removes the keys it finds */
+    Check_Type(v_options, T_HASH);
+    rb_get_kwargs(rb_hash_dup(v_options), ids, 0, count, values);
 }
 
-static const rb_data_type_t UA_Client_Type = {
-    "UA_Uninitialized_Client",
-    { 0, UA_Client_free, 0 },
-    0, 0, RUBY_TYPED_FREE_IMMEDIATELY,
+/* Request arena
+ *
+ * Building a request needs a handful of short-lived arrays (NodeIds, Variants,
+ * ReadValueIds, WriteValues, scalar storage). They are bump-allocated from a
+ * per-call arena and released in one step when the call returns or raises. */
+
+#define REQUEST_ARENA_BLOCK_SIZE 4096
+#define REQUEST_ARENA_ALIGN 8
+
+struct RequestArenaBlock {
+    struct RequestArenaBlock *next;
+    size_t size;
+    size_t used;
+    UA_UInt64 data[];
 };
 
-static VALUE allocate(VALUE klass) {
-    // printf("allocate client\n");
-    struct UninitializedClient *uclient = ALLOC(struct UninitializedClient);
-    *uclient = (const struct UninitializedClient){ 0 };
+/* Arena memory holding UA types that own heap members (e.g. decoded Variants) */
+struct RequestArenaCleanup {
+    struct RequestArenaCleanup *next;
+    void *p;
+    size_t size;
+    const UA_DataType *type;
+};
 
-    return TypedData_Wrap_Struct(klass, &UA_Client_Type, uclient);
-}
+struct RequestArena {
+    struct RequestArenaBlock *blocks;
+    struct RequestArenaCleanup *cleanups;
+    struct RequestArenaStats *stats;
+};
 
-/* Custom logger that suppresses all output */
-static void silent_log(void *context, UA_LogLevel level, UA_LogCategory category,
-                      const char *msg, va_list args) {
-    /* Do nothing - suppress all log output */
-    (void)context;
-    (void)level;
-    (void)category;
-    (void)msg;
-    (void)args;
+static struct RequestArenaBlock *requestArena_newBlock(struct RequestArena *arena, size_t size) {
+    struct RequestArenaBlock *block = xmalloc(sizeof(struct RequestArenaBlock) + size);
+    block->size = size;
+    block->used = 0;
+    arena->stats->blocks++;
+    return block;
 }
 
-static UA_Logger silent_logger = {silent_log, NULL, NULL};
+/* Zeroed memory for count elements of the given size, valid until release */
+static void *requestArena_alloc(struct RequestArena *arena, size_t count, size_t size) {
+    if (size != 0 && count > (SIZE_MAX - REQUEST_ARENA_ALIGN) / size) {
+        rb_raise(rb_eArgError, "request too large");
+    }
 
-static VALUE rb_initialize(VALUE self) {
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    size_t bytes = (count * size + REQUEST_ARENA_ALIGN - 1) & ~(size_t)(REQUEST_ARENA_ALIGN - 1);
+    struct RequestArenaBlock *block = arena->blocks;
 
-    /* Create client with default configuration */
-    uclient->client = UA_Client_new();
-    if(!uclient->client) {
-        rb_raise(cError, "Failed to create UA_Client");
-        return Qnil;
+    if (bytes > REQUEST_ARENA_BLOCK_SIZE / 2) {
+        /* Large arrays get their own block, the current one keeps serving */
+        struct RequestArenaBlock *large = requestArena_newBlock(arena, bytes);
+        if (block) {
+            large->next = block->next;
+            block->next = large;
+        } else {
+            large->next = NULL;
+            arena->blocks = large;
+        }
+        block = large;
+    } else if (!block || block->size - block->used < bytes) {
+        block = requestArena_newBlock(arena, REQUEST_ARENA_BLOCK_SIZE);
+        block->next = arena->blocks;
+        arena->blocks = block;
     }
 
-    /* Get the client config and set defaults */
-    UA_ClientConfig *config = UA_Client_getConfig(uclient->client);
-    UA_ClientConfig_setDefault(config);
+    void *p = (char*)block->data + block->used;
+    block->used += bytes;
+    memset(p, 0, bytes);
 
-    /* Replace the logger with our silent logger */
-    config->logging = &silent_logger;
+    arena->stats->allocations++;
+    arena->stats->bytes += bytes;
+    return p;
+}
 
-    /* Also silence the EventLoop logger if it exists */
-    if(config->eventLoop) {
-        config->eventLoop->logger = &silent_logger;
-    }
+/* Like requestArena_alloc, but the elements are UA_clear'ed on release */
+static void *requestArena_allocTyped(struct RequestArena *arena, size_t count, const UA_DataType *type) {
+    void *p = requestArena_alloc(arena, count, type->memSize);
 
-    /* Set custom callbacks */
-    config->stateCallback = stateCallback;
-    config->subscriptionInactivityCallback = subscriptionInactivityCallback;
+    struct RequestArenaCleanup *cleanup = requestArena_alloc(arena, 1, sizeof(struct RequestArenaCleanup));
+    cleanup->p = p;
+    cleanup->size = count;
+    cleanup->type = type;
+    cleanup->next = arena->cleanups;
+    arena->cleanups = cleanup;
 
-    /* Set up context */
-    struct OpcuaClientContext *ctx = ALLOC(struct OpcuaClientContext);
-    *ctx = (const struct OpcuaClientContext){ 0 };
-    ctx->rubyClientInstance = self;
-    config->clientContext = ctx;
+    return p;
+}
+
+static void requestArena_release(struct RequestArena *arena) {
+    for (struct RequestArenaCleanup *cleanup = arena->cleanups; cleanup; cleanup = cleanup->next) {
+        for (size_t i = 0; i < cleanup->size; i++) {
+            UA_clear((char*)cleanup->p + i * cleanup->type->memSize, cleanup->type);
+        }
+    }
+    arena->cleanups = NULL;
+
+    struct RequestArenaBlock *block = arena->blocks;
+    while (block) {
+        struct RequestArenaBlock *next = block->next;
+        xfree(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+
+    arena->stats->requests++;
+}
+
+struct RequestCall {
+    struct RequestArena arena;
+    UA_Client *client;
+    VALUE self;
+    const VALUE *argv;
+    int uaType;
+    VALUE (*body)(struct RequestCall *call);
+};
 
+static VALUE requestCall_body(VALUE v_call) {
+    struct RequestCall *call = (struct RequestCall *)v_call;
+    return call->body(call);
+}
+
+static VALUE requestCall_ensure(VALUE v_call) {
+    struct RequestCall *call = (struct RequestCall *)v_call;
+    requestArena_release(&call->arena);
     return Qnil;
 }
 
-static VALUE rb_connect(VALUE self, VALUE v_connectionString) {
-    if (RB_TYPE_P(v_connectionString, T_STRING) != 1) {
-        return raise_invalid_arguments_error();
-    }
+/* Node map
+ *
+ * Open-addressing hash map from NodeId to a dense index. Keys are owned
+ * copies, indices stay stable until the map is cleared. Features keep their
+ * per-node state in arrays indexed the same way. */
 
-    char *connectionString = StringValueCStr(v_connectionString);
+#define NODE_MAP_EMPTY ((size_t)-1)
 
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+/* Slot holding nodeId, or the empty slot where it would be inserted */
+static size_t nodeMap_slot(const struct NodeMap *map, const UA_NodeId *nodeId) {
+    size_t mask = map->slotCount - 1;
+    size_t pos = UA_NodeId_hash(nodeId) & mask;
 
-    UA_StatusCode status = UA_Client_connect(client, connectionString);
+    while (map->slots[pos] != NODE_MAP_EMPTY && !UA_NodeId_equal(&map->keys[map->slots[pos]], nodeId)) {
+        pos = (pos + 1) & mask;
+    }
 
-    if (status == UA_STATUSCODE_GOOD) {
-        return Qnil;
-    } else {
-        return raise_ua_status_error(status);
+    return pos;
+}
+
+static size_t nodeMap_find(const struct NodeMap *map, const UA_NodeId *nodeId) {
+    if (map->count == 0) {
+        return NODE_MAP_EMPTY;
     }
+
+    return map->slots[nodeMap_slot(map, nodeId)];
 }
 
-static VALUE rb_createSubscription(VALUE self) {
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+static void nodeMap_rehash(struct NodeMap *map, size_t slotCount) {
+    size_t *slots = ALLOC_N(size_t, slotCount);
+    for (size_t i = 0; i < slotCount; i++) {
+        slots[i] = NODE_MAP_EMPTY;
+    }
 
-    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
-    UA_CreateSubscriptionResponse response = UA_Client_Subscriptions_create(client, request, NULL, NULL, deleteSubscriptionCallback);
+    xfree(map->slots);
+    map->slots = slots;
+    map->slotCount = slotCount;
 
-    if (response.responseHeader.serviceResult == UA_STATUSCODE_GOOD) {
-        UA_UInt32 subscriptionId = response.subscriptionId;
-        return UINT2NUM(subscriptionId);
-    } else {
-        return Qnil;
+    for (size_t i = 0; i < map->count; i++) {
+        map->slots[nodeMap_slot(map, &map->keys[i])] = i;
     }
 }
 
-static VALUE rb_addMonitoredItem(VALUE self, VALUE v_subscriptionId, VALUE v_monNsIndex, VALUE v_monNsName) {
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+/* Index of nodeId, inserting a copy if it is not in the map yet */
+static size_t nodeMap_insert(struct NodeMap *map, const UA_NodeId *nodeId, UA_Boolean *inserted) {
+    if ((map->count + 1) * 2 > map->slotCount) {
+        nodeMap_rehash(map, map->slotCount ? map->slotCount * 2 : 64);
+    }
 
-    UA_UInt32 subscriptionId = NUM2UINT(v_subscriptionId); // TODO: check type
-    UA_UInt16 monNsIndex = NUM2USHORT(v_monNsIndex); // TODO: check type
-    char* monNsName = StringValueCStr(v_monNsName); // TODO: check type
+    size_t pos = nodeMap_slot(map, nodeId);
+    if (map->slots[pos] != NODE_MAP_EMPTY) {
+        *inserted = false;
+        return map->slots[pos];
+    }
 
-    UA_MonitoredItemCreateRequest monRequest = UA_MonitoredItemCreateRequest_default(UA_NODEID_STRING(monNsIndex, monNsName));
+    if (map->count == map->capacity) {
+        map->capacity = map->capacity ? map->capacity * 2 : 32;
+        REALLOC_N(map->keys, UA_NodeId, map->capacity);
+    }
 
-    UA_MonitoredItemCreateResult monResponse =
-    UA_Client_MonitoredItems_createDataChange(client, subscriptionId,
-                                              UA_TIMESTAMPSTORETURN_BOTH,
-                                              monRequest, NULL, handler_dataChanged, NULL);
-    if (monResponse.statusCode == UA_STATUSCODE_GOOD) {
-        // printf("Request to monitor field %hu:%s successful, id %u\n", monNsIndex, monNsName, monResponse.monitoredItemId);
-        UA_UInt32 monitoredItemId = monResponse.monitoredItemId;
-        return UINT2NUM(monitoredItemId);
-    } else {
-        // printf("Request to monitor field failed: %s\n", UA_StatusCode_name(monResponse.statusCode));
-        return Qnil;
+    UA_StatusCode status = UA_NodeId_copy(nodeId, &map->keys[map->count]);
+    if (status != UA_STATUSCODE_GOOD) {
+        raise_ua_status_error(status);
     }
+
+    map->slots[pos] = map->count;
+    *inserted = true;
+    return map->count++;
 }
 
-static VALUE rb_disconnect(VALUE self) {
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+static void nodeMap_clear(struct NodeMap *map) {
+    for (size_t i = 0; i < map->count; i++) {
+        UA_NodeId_clear(&map->keys[i]);
+    }
+    map->count = 0;
 
-    UA_StatusCode status = UA_Client_disconnect(client);
-    return RB_UINT2NUM(status);
+    for (size_t i = 0; i < map->slotCount; i++) {
+        map->slots[i] = NODE_MAP_EMPTY;
+    }
 }
 
-static UA_StatusCode multiRead(UA_Client *client, const UA_NodeId *nodeId, UA_Variant *out, const long varsCount) {
+static void nodeMap_free(struct NodeMap *map) {
+    nodeMap_clear(map);
+    xfree(map->keys);
+    xfree(map->slots);
+    *map = (const struct NodeMap){ 0 };
+}
 
-    UA_UInt16 rvSize = UA_TYPES[UA_TYPES_READVALUEID].memSize;
-    UA_ReadValueId *rValues = UA_calloc(varsCount, rvSize);
+/* Ruby representation of a NodeId identifier: String or Integer */
+static VALUE nodeIdIdentifierToRuby(const UA_NodeId *nodeId) {
+    if (nodeId->identifierType == UA_NODEIDTYPE_STRING) {
+        return rb_enc_str_new((char*)nodeId->identifier.string.data, nodeId->identifier.string.length, rb_utf8_encoding());
+    } else if (nodeId->identifierType == UA_NODEIDTYPE_NUMERIC) {
+        return UINT2NUM(nodeId->identifier.numeric);
+    }
 
-    for (int i=0; i<varsCount; i++) {
-        UA_ReadValueId *readItem = &rValues[i];
-        readItem->nodeId = nodeId[i];
-        readItem->attributeId = UA_ATTRIBUTEID_VALUE;
+    return Qnil;
+}
+
+/* UA type index for the type symbols used by the generic methods
+ * (:byte, :int32, :float, ...), matching the read_/write_ method suffixes */
+static int uaTypeFromSymbol(VALUE v_type) {
+    Check_Type(v_type, T_SYMBOL);
+    ID id = SYM2ID(v_type);
+
+    if (id == rb_intern("byte")) return UA_TYPES_BYTE;
+    if (id == rb_intern("sbyte")) return UA_TYPES_SBYTE;
+    if (id == rb_intern("int16")) return UA_TYPES_INT16;
+    if (id == rb_intern("uint16")) return UA_TYPES_UINT16;
+    if (id == rb_intern("int32")) return UA_TYPES_INT32;
+    if (id == rb_intern("uint32")) return UA_TYPES_UINT32;
+    if (id == rb_intern("int64")) return UA_TYPES_INT64;
+    if (id == rb_intern("uint64")) return UA_TYPES_UINT64;
+    if (id == rb_intern("float")) return UA_TYPES_FLOAT;
+    if (id == rb_intern("double")) return UA_TYPES_DOUBLE;
+    if (id == rb_intern("boolean") || id == rb_intern("bool")) return UA_TYPES_BOOLEAN;
+    if (id == rb_intern("string")) return UA_TYPES_STRING;
+
+    rb_raise(cError, "Unsupported type");
+    return -1;
+}
+
+/* Write queue
+ *
+ * enqueue_write collects writes per node, a later write to the same node
+ * replaces the pending one (last write wins). flush_writes, or the flush
+ * timer running inside run_mon_cycle, sends them as one WriteRequest. The
+ * answers to timer flushes are kept until the end of the cycle and handed
+ * to after_writes_flushed from there. */
+
+static void writeQueue_clear(struct WriteQueue *queue) {
+    for (size_t i = 0; i < queue->index.count; i++) {
+        UA_DataValue_clear(&queue->values[i]);
     }
+    nodeMap_clear(&queue->index);
+}
 
-    UA_ReadRequest request;
-    UA_ReadRequest_init(&request);
-    request.nodesToRead = rValues;
-    request.nodesToReadSize = varsCount;
+static void writeFlight_free(struct WriteFlushInFlight *flight) {
+    UA_Array_delete(flight->writes, flight->count, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+    UA_WriteResponse_clear(&flight->response);
+    UA_free(flight);
+}
 
-    UA_ReadResponse response = UA_Client_Service_read(client, request);
-    UA_StatusCode retval = response.responseHeader.serviceResult;
-    if(retval == UA_STATUSCODE_GOOD) {
-        if(response.resultsSize == varsCount)
-            retval = response.results[0].status;
-        else
-            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+static void writeQueue_free(struct WriteQueue *queue) {
+    writeQueue_clear(queue);
+    while (queue->flushed) {
+        struct WriteFlushInFlight *flight = queue->flushed;
+        queue->flushed = flight->next;
+        writeFlight_free(flight);
     }
+    nodeMap_free(&queue->index);
+    xfree(queue->values);
+    queue->values = NULL;
+    queue->capacity = 0;
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_ReadResponse_clear(&response);
-        UA_free(rValues);
-        return retval;
+/* Write shadow
+ *
+ * Opt-in write deduplication. The shadow holds the last value successfully
+ * written to or reported for each node. Data change items created while it
+ * is enabled add their node, so their notifications keep it current. Writes
+ * equal to the shadow, or within the deadband for numeric values, are not
+ * sent. */
+
+static void writeShadow_free(struct WriteShadow *shadow) {
+    for (size_t i = 0; i < shadow->index.count; i++) {
+        UA_Variant_clear(&shadow->values[i]);
     }
+    nodeMap_free(&shadow->index);
+    xfree(shadow->values);
+    shadow->values = NULL;
+    shadow->capacity = 0;
+}
 
-    /* Set the StatusCode */
-    UA_DataValue *results = response.results;
+/* Numeric scalar as a double, for deadband comparisons */
+static UA_Boolean variantToDouble(const UA_Variant *value, UA_Double *out) {
+    if (!value->type || !UA_Variant_isScalar(value)) {
+        return false;
+    }
 
-    if (response.resultsSize != varsCount) {
-        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
-        UA_ReadResponse_clear(&response);
-        UA_free(rValues);
-        return retval;
+    switch (value->type->typeKind) {
+        case UA_DATATYPEKIND_SBYTE: *out = *(UA_SByte*)value->data; return true;
+        case UA_DATATYPEKIND_BYTE: *out = *(UA_Byte*)value->data; return true;
+        case UA_DATATYPEKIND_INT16: *out = *(UA_Int16*)value->data; return true;
+        case UA_DATATYPEKIND_UINT16: *out = *(UA_UInt16*)value->data; return true;
+        case UA_DATATYPEKIND_INT32: *out = *(UA_Int32*)value->data; return true;
+        case UA_DATATYPEKIND_UINT32: *out = *(UA_UInt32*)value->data; return true;
+        case UA_DATATYPEKIND_INT64: *out = (UA_Double)*(UA_Int64*)value->data; return true;
+        case UA_DATATYPEKIND_UINT64: *out = (UA_Double)*(UA_UInt64*)value->data; return true;
+        case UA_DATATYPEKIND_FLOAT: *out = *(UA_Float*)value->data; return true;
+        case UA_DATATYPEKIND_DOUBLE: *out = *(UA_Double*)value->data; return true;
+        default: return false;
     }
+}
 
-    for (int i=0; i<varsCount; i++) {
-        if ((results[i].hasStatus && results[i].status != UA_STATUSCODE_GOOD) || !results[i].hasValue) {
-            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
-            UA_ReadResponse_clear(&response);
-            UA_free(rValues);
-            return retval;
+/* True if the write can be skipped */
+static UA_Boolean writeShadow_matches(const struct WriteShadow *shadow, const UA_NodeId *nodeId, const UA_Variant *value) {
+    if (!shadow->enabled) {
+        return false;
+    }
+
+    UA_Boolean same = false;
+    size_t index = nodeMap_find(&shadow->index, nodeId);
+
+    if (index != NODE_MAP_EMPTY && shadow->values[index].type == value->type) {
+        const UA_Variant *last = &shadow->values[index];
+        UA_Double lastNumber, newNumber;
+
+        if (shadow->deadband > 0 && variantToDouble(last, &lastNumber) && variantToDouble(value, &newNumber)) {
+            same = fabs(newNumber - lastNumber) <= shadow->deadband;
+        } else {
+            same = UA_order(last, value, &UA_TYPES[UA_TYPES_VARIANT]) == UA_ORDER_EQ;
         }
     }
 
-    for (int i=0; i<varsCount; i++) {
-        out[i] = results[i].value;
-        UA_Variant_init(&results[i].value);
+    return same;
+}
+
+/* Counts skipped and sent writes, once the request that sent them succeeded */
+static void writeShadow_count(struct WriteShadow *shadow, size_t hits, size_t misses) {
+    if (shadow->enabled) {
+        shadow->hits += hits;
+        shadow->misses += misses;
     }
+}
 
-    UA_ReadResponse_clear(&response);
-    UA_free(rValues);
-    return retval;
+/* Index of the node in the shadow, adding it with an empty value. Values
+ * grow first, so a failed allocation leaves no index past them. */
+static size_t writeShadow_slot(struct WriteShadow *shadow, const UA_NodeId *nodeId) {
+    if (shadow->capacity <= shadow->index.count) {
+        size_t capacity = shadow->capacity ? shadow->capacity * 2 : 32;
+        REALLOC_N(shadow->values, UA_Variant, capacity);
+        memset(&shadow->values[shadow->capacity], 0, (capacity - shadow->capacity) * sizeof(UA_Variant));
+        shadow->capacity = capacity;
+    }
+
+    UA_Boolean inserted;
+    return nodeMap_insert(&shadow->index, nodeId, &inserted);
 }
 
-static UA_StatusCode multiWrite(UA_Client *client, const UA_NodeId *nodeId, const UA_Variant *in, const long varsSize) {
-    UA_AttributeId attributeId = UA_ATTRIBUTEID_VALUE;
+static void writeShadow_store(struct WriteShadow *shadow, const UA_NodeId *nodeId, const UA_Variant *value) {
+    if (!shadow->enabled) {
+        return;
+    }
 
-    UA_UInt16 wvSize = UA_TYPES[UA_TYPES_WRITEVALUE].memSize;
+    size_t index = writeShadow_slot(shadow, nodeId);
+
+    /* An empty variant (copy failed) never matches, so the next write is sent */
+    UA_Variant_clear(&shadow->values[index]);
+    UA_Variant_copy(value, &shadow->values[index]);
+}
 
-    UA_WriteValue *wValues = UA_calloc(varsSize, wvSize);
+/* Adds a node about to be monitored, its notifications fill in the value */
+static void writeShadow_watch(struct WriteShadow *shadow, const UA_NodeId *nodeId) {
+    if (shadow->enabled) {
+        writeShadow_slot(shadow, nodeId);
+    }
+}
 
-    for (int i=0; i<varsSize; i++) {
-        UA_WriteValue *wValue = &wValues[i];
-        wValue->attributeId = attributeId;
-        wValue->nodeId = nodeId[i];
-        wValue->value.value = in[i];
-        wValue->value.hasValue = true;
+/* A monitored value for a node in the shadow. Called from open62541
+ * callbacks, so it neither allocates through Ruby nor raises. Values with
+ * a bad or uncertain status are not what a write would compare against. */
+static void writeShadow_refresh(struct WriteShadow *shadow, const UA_NodeId *nodeId, const UA_DataValue *value) {
+    if (!shadow->enabled || !value->hasValue || (value->hasStatus && !UA_StatusCode_isGood(value->status))) {
+        return;
     }
 
-    UA_WriteRequest wReq;
-    UA_WriteRequest_init(&wReq);
-    wReq.nodesToWrite = wValues;
-    wReq.nodesToWriteSize = varsSize;
+    size_t index = nodeMap_find(&shadow->index, nodeId);
+    if (index == NODE_MAP_EMPTY) {
+        return;
+    }
 
-    UA_WriteResponse wResp = UA_Client_Service_write(client, wReq);
+    UA_Variant_clear(&shadow->values[index]);
+    UA_Variant_copy(&value->value, &shadow->values[index]);
+}
 
-    UA_StatusCode retval = wResp.responseHeader.serviceResult;
-    if(retval == UA_STATUSCODE_GOOD) {
-        if(wResp.resultsSize == varsSize) {
-            retval = wResp.results[0];
+/* Notification batches
+ *
+ * When after_data_changed_batch is set, notifications received while
+ * run_mon_cycle runs are collected natively and handed to Ruby in one call
+ * as columns, instead of after_data_changed or item blocks, so the Ruby
+ * overhead scales with cycles instead of values. */
 
-            for (int i=0; i<wResp.resultsSize; i++) {
-                if (wResp.results[i] != UA_STATUSCODE_GOOD) {
-                    retval = wResp.results[i];
-                    // printf("%s\n", "multiWrite: bad result found");
-                    break;
-                }
-            }
+static void notificationBatch_clear(struct NotificationBatch *batch) {
+    for (size_t i = 0; i < batch->count; i++) {
+        UA_DataValue_clear(&batch->values[i]);
+    }
+    batch->count = 0;
+}
 
-            if (retval == UA_STATUSCODE_GOOD) {
-                // printf("%s\n", "multiWrite: all vars written");
-            }
-        } else {
-            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
-            // printf("%s\n", "multiWrite: bad resultsSize");
+static void notificationBatch_free(struct NotificationBatch *batch) {
+    notificationBatch_clear(batch);
+    UA_free(batch->subscriptionIds);
+    UA_free(batch->monitoredItemIds);
+    UA_free(batch->timestampFormats);
+    UA_free(batch->values);
+    UA_free(batch->received);
+    *batch = (const struct NotificationBatch){ 0 };
+}
+
+/* Takes over the notification value, the client only clears it afterwards */
+static void notificationBatch_append(struct NotificationBatch *batch, UA_UInt32 subId, UA_UInt32 monId,
+        enum TimestampFormat format, UA_DataValue *value, UA_DateTime received) {
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        UA_UInt32 *subscriptionIds = UA_realloc(batch->subscriptionIds, capacity * sizeof(UA_UInt32));
+        if (subscriptionIds) batch->subscriptionIds = subscriptionIds;
+        UA_UInt32 *monitoredItemIds = UA_realloc(batch->monitoredItemIds, capacity * sizeof(UA_UInt32));
+        if (monitoredItemIds) batch->monitoredItemIds = monitoredItemIds;
+        UA_Byte *timestampFormats = UA_realloc(batch->timestampFormats, capacity);
+        if (timestampFormats) batch->timestampFormats = timestampFormats;
+        UA_DataValue *values = UA_realloc(batch->values, capacity * sizeof(UA_DataValue));
+        if (values) batch->values = values;
+        UA_DateTime *receivedTimes = UA_realloc(batch->received, capacity * sizeof(UA_DateTime));
+        if (receivedTimes) batch->received = receivedTimes;
+
+        if (!subscriptionIds || !monitoredItemIds || !timestampFormats || !values || !receivedTimes) {
+            batch->dropped++;
+            return;
         }
-    } else {
-        // printf("%s\n", "multiWrite: bad write");
+        batch->capacity = capacity;
     }
 
-    UA_WriteResponse_clear(&wResp);
-    UA_free(wValues);
-
-    return retval;
+    size_t i = batch->count++;
+    batch->subscriptionIds[i] = subId;
+    batch->monitoredItemIds[i] = monId;
+    batch->timestampFormats[i] = (UA_Byte)format;
+    batch->values[i] = *value;
+    batch->received[i] = received;
+    UA_DataValue_init(value);
 }
 
-static VALUE rb_readUaValues(VALUE self, VALUE v_nsIndex, VALUE v_aryNames) {
-    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
-        return raise_invalid_arguments_error();
+/* Columns: subscription ids, monitored item ids, server times, source times,
+ * values and statuses */
+#define NOTIFICATION_COLUMNS 6
+
+static void notificationColumns_init(VALUE *columns, size_t count) {
+    for (int i = 0; i < NOTIFICATION_COLUMNS; i++) {
+        columns[i] = rb_ary_new_capa(count);
     }
+}
 
-    Check_Type(v_aryNames, T_ARRAY);
-    const long namesCount = RARRAY_LEN(v_aryNames);
+static void notificationColumns_push(VALUE *columns, UA_UInt32 subId, UA_UInt32 monId,
+        enum TimestampFormat format, const UA_DataValue *value) {
+    rb_ary_push(columns[0], UINT2NUM(subId));
+    rb_ary_push(columns[1], UINT2NUM(monId));
+    rb_ary_push(columns[2], value->hasServerTimestamp ? toRubyTimestamp(value->serverTimestamp, format) : Qnil);
+    rb_ary_push(columns[3], value->hasSourceTimestamp ? toRubyTimestamp(value->sourceTimestamp, format) : Qnil);
+    rb_ary_push(columns[4], value->hasValue ? variantScalarToRuby(&value->value, format) : Qnil);
+    rb_ary_push(columns[5], UINT2NUM(value->hasStatus ? value->status : UA_STATUSCODE_GOOD));
+}
 
-    int nsIndex = FIX2INT(v_nsIndex);
+/* Empties the batch */
+static VALUE notificationBatch_toRuby(struct NotificationBatch *batch) {
+    VALUE columns[NOTIFICATION_COLUMNS];
+    notificationColumns_init(columns, batch->count);
 
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+    for (size_t i = 0; i < batch->count; i++) {
+        notificationColumns_push(columns, batch->subscriptionIds[i], batch->monitoredItemIds[i],
+                                 (enum TimestampFormat)batch->timestampFormats[i], &batch->values[i]);
+    }
 
-    UA_UInt16 nidSize = UA_TYPES[UA_TYPES_NODEID].memSize;
-    UA_UInt16 variantSize = UA_TYPES[UA_TYPES_VARIANT].memSize;
+    notificationBatch_clear(batch);
 
-    UA_NodeId *nodes = UA_calloc(namesCount, nidSize);
-    UA_Variant *readValues = UA_calloc(namesCount, variantSize);
+    return rb_ary_new_from_values(NOTIFICATION_COLUMNS, columns);
+}
 
-    for (int i=0; i<namesCount; i++) {
-        VALUE v_name = rb_ary_entry(v_aryNames, i);
+static void notificationBatch_deliver(struct OpcuaClientContext *ctx, VALUE callback) {
+    if (ctx->notificationBatch.count == 0) {
+        return;
+    }
 
-        if (RB_TYPE_P(v_name, T_STRING) != 1) {
-            return raise_invalid_arguments_error();
+    if (NIL_P(callback)) {
+        notificationBatch_clear(&ctx->notificationBatch);
+        return;
+    }
+
+    if (ctx->latency.enabled) {
+        struct NotificationBatch *batch = &ctx->notificationBatch;
+        UA_DateTime now = UA_DateTime_now();
+        for (size_t i = 0; i < batch->count; i++) {
+            latency_delivered(&ctx->latency, &batch->values[i], batch->received[i], now);
         }
+    }
 
-        char *name = StringValueCStr(v_name);
-        nodes[i] = UA_NODEID_STRING(nsIndex, name);
+    rb_proc_call(callback, notificationBatch_toRuby(&ctx->notificationBatch));
+}
+
+/* Notification ring buffer
+ *
+ * With the buffer enabled, notifications are only copied into a bounded
+ * native ring and Ruby drains it at its own pace, so a slow consumer never
+ * stalls UA_Client_run_iterate. When the ring is full the overflow policy
+ * decides: drop the oldest entry, drop the new notification, or replace the
+ * pending entry of the same item (falling back to dropping the oldest). */
+
+static void notificationRing_pop(struct NotificationRing *ring) {
+    size_t slot = ring->head;
+    struct MonitoredItemContext *item = ring->items[slot];
+    if (item && item->ringSlot == slot + 1) {
+        item->ringSlot = 0;
     }
 
-    UA_StatusCode status = multiRead(client, nodes, readValues, namesCount);
+    UA_DataValue_clear(&ring->values[slot]);
+    ring->head = (ring->head + 1) % ring->capacity;
+    ring->count--;
+}
 
-    VALUE resultArray = Qnil;
+static void notificationRing_free(struct NotificationRing *ring) {
+    while (ring->count > 0) {
+        notificationRing_pop(ring);
+    }
+    UA_free(ring->subscriptionIds);
+    UA_free(ring->monitoredItemIds);
+    UA_free(ring->timestampFormats);
+    UA_free(ring->items);
+    UA_free(ring->values);
+    UA_free(ring->received);
+    *ring = (const struct NotificationRing){ 0 };
+}
 
-    if (status == UA_STATUSCODE_GOOD) {
-        // printf("%s\n", "value read successful");
+static UA_StatusCode notificationRing_init(struct NotificationRing *ring, size_t capacity, enum OverflowPolicy policy) {
+    notificationRing_free(ring);
 
-        resultArray = rb_ary_new2(namesCount);
-
-        for (int i=0; i<namesCount; i++) {
-            // printf("the value is: %i\n", val);
-
-            VALUE rubyVal = Qnil;
-
-            if (UA_Variant_hasScalarType(&readValues[i], &UA_TYPES[UA_TYPES_INT16])) {
-                UA_Int16 val = *(UA_Int16*)readValues[i].data;
-                rubyVal = INT2FIX(val);
-            } else if (UA_Variant_hasScalarType(&readValues[i], &UA_TYPES[UA_TYPES_UINT16])) {
-                UA_UInt16 val = *(UA_UInt16*)readValues[i].data;
-                rubyVal = INT2FIX(val);
-            } else if (UA_Variant_hasScalarType(&readValues[i], &UA_TYPES[UA_TYPES_INT32])) {
-                 UA_Int32 val = *(UA_Int32*)readValues[i].data;
-                 rubyVal = INT2FIX(val);
-            } else if (UA_Variant_hasScalarType(&readValues[i], &UA_TYPES[UA_TYPES_UINT32])) {
-                 UA_UInt32 val = *(UA_UInt32*)readValues[i].data;
-                 rubyVal = INT2FIX(val);
-            } else if (UA_Variant_hasScalarType(&readValues[i], &UA_TYPES[UA_TYPES_BOOLEAN])) {
-                 UA_Boolean val = *(UA_Boolean*)readValues[i].data;
-                 rubyVal = val ? Qtrue : Qfalse;
-            } else if (UA_Variant_hasScalarType(&readValues[i], &UA_TYPES[UA_TYPES_FLOAT])) {
-                 UA_Float val = *(UA_Float*)readValues[i].data;
-                 rubyVal = DBL2NUM(val);
-            } else {
-                rubyVal = Qnil; // unsupported
-            }
+    ring->subscriptionIds = UA_malloc(capacity * sizeof(UA_UInt32));
+    ring->monitoredItemIds = UA_malloc(capacity * sizeof(UA_UInt32));
+    ring->timestampFormats = UA_malloc(capacity);
+    ring->items = UA_malloc(capacity * sizeof(struct MonitoredItemContext*));
+    ring->values = UA_malloc(capacity * sizeof(UA_DataValue));
+    ring->received = UA_malloc(capacity * sizeof(UA_DateTime));
 
-            rb_ary_push(resultArray, rubyVal);
-        }
-    } else {
-        /* Clean up */
-        for (int i=0; i<namesCount; i++) {
-            UA_Variant_clear(&readValues[i]);
+    if (!ring->subscriptionIds || !ring->monitoredItemIds || !ring->timestampFormats || !ring->items || !ring->values ||
+        !ring->received) {
+        notificationRing_free(ring);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    ring->capacity = capacity;
+    ring->policy = policy;
+    ring->enabled = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Takes over the notification value like notificationBatch_append */
+static void notificationRing_push(struct NotificationRing *ring, UA_UInt32 subId, UA_UInt32 monId,
+        struct MonitoredItemContext *item, enum TimestampFormat format, UA_DataValue *value, UA_DateTime received) {
+    if (ring->count == ring->capacity) {
+        if (ring->policy == OVERFLOW_COALESCE && item && item->ringSlot) {
+            size_t slot = item->ringSlot - 1;
+            UA_DataValue_clear(&ring->values[slot]);
+            ring->values[slot] = *value;
+            ring->timestampFormats[slot] = (UA_Byte)format;
+            ring->received[slot] = received;
+            UA_DataValue_init(value);
+            ring->coalesced++;
+            return;
         }
-        UA_free(nodes);
-        UA_free(readValues);
 
-        return raise_ua_status_error(status);
+        ring->dropped++;
+        if (ring->policy == OVERFLOW_DROP_NEWEST) {
+            return;
+        }
+        notificationRing_pop(ring);
     }
 
-    /* Clean up */
-    for (int i=0; i<namesCount; i++) {
-        UA_Variant_clear(&readValues[i]);
+    size_t slot = (ring->head + ring->count) % ring->capacity;
+    ring->subscriptionIds[slot] = subId;
+    ring->monitoredItemIds[slot] = monId;
+    ring->timestampFormats[slot] = (UA_Byte)format;
+    ring->items[slot] = item;
+    ring->values[slot] = *value;
+    ring->received[slot] = received;
+    UA_DataValue_init(value);
+
+    if (item) {
+        item->ringSlot = slot + 1;
     }
-    UA_free(nodes);
-    UA_free(readValues);
 
-    return resultArray;
+    ring->count++;
+    ring->pushed++;
+    if (ring->count > ring->highWater) {
+        ring->highWater = ring->count;
+    }
 }
 
-static VALUE rb_writeUaValues(VALUE self, VALUE v_nsIndex, VALUE v_aryNames, VALUE v_aryNewValues, int uaType) {
-    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
-        return raise_invalid_arguments_error();
+/* Item contexts
+ *
+ * Every monitored item created through the client carries a context with its
+ * node, block and tag, linked into the client context so the Ruby objects
+ * are marked. A context handed to an open62541 create call together with
+ * monitoredItemDeleted belongs to open62541 from then on: monitoredItemDeleted
+ * frees it when the item is deleted, and also when the creation fails. */
+
+static struct MonitoredItemContext *monitoredItemContext_new(struct OpcuaClientContext *ctx, const UA_NodeId *nodeId,
+        VALUE v_handler, VALUE v_tag) {
+    struct MonitoredItemContext *item = UA_calloc(1, sizeof(struct MonitoredItemContext));
+    if (!item || UA_NodeId_copy(nodeId, &item->nodeId) != UA_STATUSCODE_GOOD) {
+        UA_free(item);
+        return NULL;
     }
 
-    Check_Type(v_aryNames, T_ARRAY);
-    Check_Type(v_aryNewValues, T_ARRAY);
-
-    const long namesCount = RARRAY_LEN(v_aryNames);
-    const long valuesCount = RARRAY_LEN(v_aryNewValues);
-
-    if (namesCount != valuesCount) {
-        return raise_invalid_arguments_error();
+    item->handler = v_handler;
+    item->tag = v_tag;
+    item->next = ctx->monitoredItems;
+    if (item->next) {
+        item->next->prev = item;
     }
+    ctx->monitoredItems = item;
+    return item;
+}
 
-    int nsIndex = FIX2INT(v_nsIndex);
+static void monitoredItemDeleted(UA_Client *client, UA_UInt32 subId, void *subContext,
+        UA_UInt32 monId, void *monContext) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct MonitoredItemContext *item = monContext;
 
-    struct UninitializedClient * uclient;
-    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+    if (item->prev) {
+        item->prev->next = item->next;
+    } else {
+        ctx->monitoredItems = item->next;
+    }
+    if (item->next) {
+        item->next->prev = item->prev;
+    }
 
-    UA_UInt16 nidSize = UA_TYPES[UA_TYPES_NODEID].memSize;
-    UA_UInt16 variantSize = UA_TYPES[UA_TYPES_VARIANT].memSize;
+    /* Pending ring entries outlive the item */
+    if (item->ringSlot) {
+        ctx->notificationRing.items[item->ringSlot - 1] = NULL;
+    }
 
-    UA_NodeId *nodes = UA_calloc(namesCount, nidSize);
-    UA_Variant *values = UA_calloc(namesCount, variantSize);
+    if (item->staleSlot) {
+        staleness_untrack(ctx, item);
+    }
 
-    for (int i=0; i<namesCount; i++) {
-        VALUE v_name = rb_ary_entry(v_aryNames, i);
-        VALUE v_newValue = rb_ary_entry(v_aryNewValues, i);
+    UA_NodeId_clear(&item->nodeId);
+    UA_free(item);
+}
 
-        if (RB_TYPE_P(v_name, T_STRING) != 1) {
-            return raise_invalid_arguments_error();
+/* Contexts and callbacks for a chunk of data change items, with the block
+ * and tag of each. Returns how many were prepared, fewer than count only
+ * when memory runs out. */
+static size_t dataChangeItems_prepare(struct OpcuaClientContext *ctx, const UA_MonitoredItemCreateRequest *items,
+        const VALUE *handlers, const VALUE *tags, size_t count, void **contexts,
+        UA_Client_DataChangeNotificationCallback *callbacks, UA_Client_DeleteMonitoredItemCallback *deleteCallbacks) {
+    for (size_t i = 0; i < count; i++) {
+        contexts[i] = monitoredItemContext_new(ctx, &items[i].itemToMonitor.nodeId, handlers[i], tags[i]);
+        if (!contexts[i]) {
+            return i;
         }
+        callbacks[i] = handler_dataChanged;
+        deleteCallbacks[i] = monitoredItemDeleted;
+    }
+    return count;
+}
 
-        char *name = StringValueCStr(v_name);
+/* Subscription records
+ *
+ * With preserve_subscriptions enabled, every subscription and monitored item
+ * created through the client is recorded with its create request, handler
+ * and tag. A session that is only reactivated keeps its subscriptions in
+ * open62541; when the session is replaced, open62541 drops them and the
+ * recorded ones are recreated in bulk after the new session is up. */
+
+static struct SubscriptionRecord *subscriptionRecord_find(struct OpcuaClientContext *ctx, UA_UInt32 subscriptionId) {
+    for (struct SubscriptionRecord *record = ctx->subscriptionRecords; record; record = record->next) {
+        if (!record->lost && record->subscriptionId == subscriptionId) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+static void subscriptionRecord_add(struct OpcuaClientContext *ctx, UA_UInt32 subscriptionId,
+        const UA_CreateSubscriptionRequest *request, void *context) {
+    struct SubscriptionRecord *record = UA_calloc(1, sizeof(struct SubscriptionRecord));
+    if (!record) {
+        return;
+    }
+
+    record->subscriptionId = subscriptionId;
+    record->request = *request;
+    record->context = context;
+    record->next = ctx->subscriptionRecords;
+    ctx->subscriptionRecords = record;
+}
+
+static void subscriptionRecord_addItem(struct SubscriptionRecord *record, const UA_MonitoredItemCreateRequest *request,
+        UA_UInt32 monitoredItemId, VALUE v_handler, VALUE v_tag) {
+    if (record->itemCount == record->itemCapacity) {
+        size_t capacity = record->itemCapacity ? record->itemCapacity * 2 : 16;
+        UA_MonitoredItemCreateRequest *items = UA_realloc(record->items, capacity * sizeof(UA_MonitoredItemCreateRequest));
+        if (items) record->items = items;
+        UA_UInt32 *itemIds = UA_realloc(record->itemIds, capacity * sizeof(UA_UInt32));
+        if (itemIds) record->itemIds = itemIds;
+        VALUE *handlers = UA_realloc(record->handlers, capacity * sizeof(VALUE));
+        if (handlers) record->handlers = handlers;
+        VALUE *tags = UA_realloc(record->tags, capacity * sizeof(VALUE));
+        if (tags) record->tags = tags;
+
+        if (!items || !itemIds || !handlers || !tags) {
+            return;
+        }
+        record->itemCapacity = capacity;
+    }
+
+    size_t i = record->itemCount;
+    if (UA_MonitoredItemCreateRequest_copy(request, &record->items[i]) != UA_STATUSCODE_GOOD) {
+        return;
+    }
+    record->itemIds[i] = monitoredItemId;
+    record->handlers[i] = v_handler;
+    record->tags[i] = v_tag;
+    record->itemCount++;
+}
+
+static void subscriptionRecord_setLink(struct SubscriptionRecord *record, UA_UInt32 triggeringId, UA_UInt32 triggeredId,
+        UA_Boolean linked) {
+    for (size_t i = 0; i < record->linkCount; i++) {
+        if (record->links[i].triggeringId == triggeringId && record->links[i].triggeredId == triggeredId) {
+            if (!linked) {
+                record->links[i] = record->links[--record->linkCount];
+            }
+            return;
+        }
+    }
+
+    if (!linked) {
+        return;
+    }
+
+    if (record->linkCount == record->linkCapacity) {
+        size_t capacity = record->linkCapacity ? record->linkCapacity * 2 : 16;
+        struct TriggerLink *links = UA_realloc(record->links, capacity * sizeof(struct TriggerLink));
+        if (!links) {
+            return;
+        }
+        record->links = links;
+        record->linkCapacity = capacity;
+    }
+
+    record->links[record->linkCount++] = (struct TriggerLink){ triggeringId, triggeredId };
+}
+
+static void subscriptionRecord_free(struct SubscriptionRecord *record) {
+    for (size_t i = 0; i < record->itemCount; i++) {
+        UA_MonitoredItemCreateRequest_clear(&record->items[i]);
+    }
+    UA_free(record->items);
+    UA_free(record->itemIds);
+    UA_free(record->handlers);
+    UA_free(record->tags);
+    UA_free(record->links);
+    UA_free(record);
+}
+
+static void subscriptionRecords_free(struct OpcuaClientContext *ctx) {
+    while (ctx->subscriptionRecords) {
+        struct SubscriptionRecord *record = ctx->subscriptionRecords;
+        ctx->subscriptionRecords = record->next;
+        subscriptionRecord_free(record);
+    }
+}
+
+static void UA_Client_mark(void *self) {
+    struct UninitializedClient *uclient = self;
+
+    if (uclient->client) {
+        struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+        for (struct MonitoredItemContext *item = ctx->monitoredItems; item; item = item->next) {
+            rb_gc_mark(item->handler);
+            rb_gc_mark(item->tag);
+        }
+        for (struct SubscriptionRecord *record = ctx->subscriptionRecords; record; record = record->next) {
+            for (size_t i = 0; i < record->itemCount; i++) {
+                rb_gc_mark(record->handlers[i]);
+                rb_gc_mark(record->tags[i]);
+            }
+        }
+    }
+}
+
+static void UA_Client_free(void *self) {
+    // printf("free client\n");
+    struct UninitializedClient *uclient = self;
+
+    if (uclient->client) {
+        struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+        /* Callbacks fired while the client shuts down must not call into Ruby */
+        ctx->deleting = true;
+        UA_Client_delete(uclient->client);
+        writeQueue_free(&ctx->writeQueue);
+        writeShadow_free(&ctx->writeShadow);
+        notificationBatch_free(&ctx->notificationBatch);
+        notificationRing_free(&ctx->notificationRing);
+        subscriptionRecords_free(ctx);
+        subscriptionStats_free(ctx);
+        UA_free(ctx->staleness.entries);
+        UA_free(ctx->staleness.index);
+        UA_NodeId_clear(&ctx->reconnect.sessionToken);
+        xfree(ctx);
+    }
+
+    xfree(self);
+}
+
+static const rb_data_type_t UA_Client_Type = {
+    "UA_Uninitialized_Client",
+    { UA_Client_mark, UA_Client_free, 0 },
+    0, 0, RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE allocate(VALUE klass) {
+    // printf("allocate client\n");
+    struct UninitializedClient *uclient = ALLOC(struct UninitializedClient);
+    *uclient = (const struct UninitializedClient){ 0 };
+
+    return TypedData_Wrap_Struct(klass, &UA_Client_Type, uclient);
+}
+
+/* Run body with a fresh request arena that is released when it returns or raises */
+static VALUE withRequestArena(VALUE self, VALUE (*body)(struct RequestCall *call), const VALUE *argv, int uaType) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+
+    struct RequestCall call = { 0 };
+    call.arena.stats = &ctx->arenaStats;
+    call.client = uclient->client;
+    call.self = self;
+    call.argv = argv;
+    call.uaType = uaType;
+    call.body = body;
+
+    return rb_ensure(requestCall_body, (VALUE)&call, requestCall_ensure, (VALUE)&call);
+}
+
+/* Custom logger that suppresses all output */
+static void silent_log(void *context, UA_LogLevel level, UA_LogCategory category,
+                      const char *msg, va_list args) {
+    /* Do nothing - suppress all log output */
+    (void)context;
+    (void)level;
+    (void)category;
+    (void)msg;
+    (void)args;
+}
+
+static UA_Logger silent_logger = {silent_log, NULL, NULL};
+
+/* Client.new keywords, applied over the open62541 defaults: timeouts in
+ * milliseconds, then the local side of the binary connection config */
+struct ClientOption {
+    const char *name;
+    size_t offset; /* of the UA_UInt32 in UA_ClientConfig */
+    UA_UInt32 min;
+};
+
+/* 8192 is the smallest chunk OPC UA allows; only the message size and chunk
+ * count may be 0, for unbounded */
+static const struct ClientOption clientOptions[] = {
+    { "timeout", offsetof(UA_ClientConfig, timeout), 1 },
+    { "secure_channel_lifetime", offsetof(UA_ClientConfig, secureChannelLifeTime), 1 },
+    { "session_timeout", offsetof(UA_ClientConfig, requestedSessionTimeout), 1 },
+    { "recv_buffer_size", offsetof(UA_ClientConfig, localConnectionConfig.recvBufferSize), 8192 },
+    { "send_buffer_size", offsetof(UA_ClientConfig, localConnectionConfig.sendBufferSize), 8192 },
+    { "max_message_size", offsetof(UA_ClientConfig, localConnectionConfig.localMaxMessageSize), 0 },
+    { "max_chunk_count", offsetof(UA_ClientConfig, localConnectionConfig.localMaxChunkCount), 0 }
+};
+
+#define CLIENT_OPTIONS (int)(sizeof(clientOptions) / sizeof(clientOptions[0]))
+
+static void clientOptionsFromRuby(VALUE v_options, VALUE *values) {
+    const char *names[CLIENT_OPTIONS];
+    for (int i = 0; i < CLIENT_OPTIONS; i++) {
+        names[i] = clientOptions[i].name;
+    }
+    keywordsFromRuby(v_options, names, CLIENT_OPTIONS, values);
+
+    for (int i = 0; i < CLIENT_OPTIONS; i++) {
+        if (values[i] == Qundef) {
+            continue;
+        }
+
+        UA_UInt32 value = NUM2UINT(values[i]);
+        if (value < clientOptions[i].min) {
+            if (clientOptions[i].min == 1) {
+                rb_raise(rb_eArgError, "%s must be positive", names[i]);
+            }
+            rb_raise(rb_eArgError, "%s must be at least %u bytes", names[i], clientOptions[i].min);
+        }
+    }
+}
+
+static void clientOptions_apply(UA_ClientConfig *config, const VALUE *values) {
+    for (int i = 0; i < CLIENT_OPTIONS; i++) {
+        if (values[i] != Qundef) {
+            *(UA_UInt32*)((char*)config + clientOptions[i].offset) = NUM2UINT(values[i]);
+        }
+    }
+}
+
+static VALUE rb_initialize(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+
+    VALUE v_options;
+    rb_scan_args(argc, argv, "0:", &v_options);
+
+    /* Raise before anything is allocated */
+    VALUE options[CLIENT_OPTIONS];
+    clientOptionsFromRuby(v_options, options);
+
+    /* Create client with default configuration */
+    uclient->client = UA_Client_new();
+    if(!uclient->client) {
+        rb_raise(cError, "Failed to create UA_Client");
+        return Qnil;
+    }
+
+    /* Get the client config and set defaults */
+    UA_ClientConfig *config = UA_Client_getConfig(uclient->client);
+    UA_ClientConfig_setDefault(config);
+    clientOptions_apply(config, options);
+
+    /* Replace the logger with our silent logger */
+    config->logging = &silent_logger;
+
+    /* Also silence the EventLoop logger if it exists */
+    if(config->eventLoop) {
+        config->eventLoop->logger = &silent_logger;
+    }
+
+    /* Set custom callbacks */
+    config->stateCallback = stateCallback;
+    config->subscriptionInactivityCallback = subscriptionInactivityCallback;
+
+    /* Set up context */
+    struct OpcuaClientContext *ctx = ALLOC(struct OpcuaClientContext);
+    *ctx = (const struct OpcuaClientContext){ 0 };
+    ctx->rubyClientInstance = self;
+    ctx->writeChunkSize = 1000;
+    ctx->queueSize = 1;
+    config->clientContext = ctx;
+
+    return Qnil;
+}
+
+/* Automatic reconnect
+ *
+ * open62541 reconnects a lost SecureChannel immediately from
+ * UA_Client_run_iterate, so every client retries at once when a network
+ * outage ends. With auto reconnect enabled that is switched off
+ * (noReconnect) and run_mon_cycle reconnects instead, after a jittered,
+ * exponentially growing delay. An attempt is an asynchronous connect that
+ * the following cycles carry on with UA_Client_run_iterate, so a server that
+ * is slow to answer blocks no cycle for longer than a regular one, and
+ * client callbacks keep running with the GVL. On the new channel open62541
+ * first activates the existing session and only creates a new one when the
+ * server no longer knows it; recorded subscriptions then follow through
+ * recovery. after_connection_state_changed is called on every transition. */
+
+static VALUE connectionStateToSymbol(enum ConnectionState state) {
+    switch (state) {
+        case CONNECTION_CONNECTED: return ID2SYM(rb_intern("connected"));
+        case CONNECTION_RECONNECTING: return ID2SYM(rb_intern("reconnecting"));
+        default: return ID2SYM(rb_intern("disconnected"));
+    }
+}
+
+static void connectionState_notify(VALUE self, struct Reconnect *reconnect, enum ConnectionState state, VALUE v_info) {
+    reconnect->state = state;
+
+    VALUE callback = rb_ivar_get(self, rb_intern("@callback_after_connection_state_changed"));
+    if (!NIL_P(callback)) {
+        VALUE params = rb_ary_new();
+        rb_ary_push(params, connectionStateToSymbol(state));
+        rb_ary_push(params, v_info);
+        rb_proc_call(callback, params);
+    }
+}
+
+/* Waits the current delay, give or take the jitter, and grows it for the next attempt */
+static UA_Double reconnect_schedule(struct Reconnect *reconnect) {
+    UA_Double spread = reconnect->jitter * (2.0 * UA_UInt32_random() / UINT32_MAX - 1.0);
+    UA_Double wait = reconnect->delay * (1.0 + spread);
+
+    reconnect->nextAttempt = UA_DateTime_nowMonotonic() + (UA_DateTime)(wait * UA_DATETIME_SEC);
+    reconnect->delay = fmin(reconnect->delay * reconnect->multiplier, reconnect->maxDelay);
+    return wait;
+}
+
+static void reconnect_failed(VALUE self, struct Reconnect *reconnect, UA_StatusCode status) {
+    reconnect->connecting = false;
+
+    VALUE v_info = rb_hash_new();
+    rb_hash_aset(v_info, ID2SYM(rb_intern("attempt")), UINT2NUM(reconnect->attempt));
+    rb_hash_aset(v_info, ID2SYM(rb_intern("status")), UINT2NUM(status));
+    rb_hash_aset(v_info, ID2SYM(rb_intern("retry_in")), DBL2NUM(reconnect_schedule(reconnect)));
+    connectionState_notify(self, reconnect, CONNECTION_DISCONNECTED, v_info);
+}
+
+/* Follows the session state after connect, disconnect and every cycle */
+static void connectionState_update(VALUE self, UA_Client *client) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct Reconnect *reconnect = &ctx->reconnect;
+
+    UA_SecureChannelState channelState;
+    UA_SessionState sessionState;
+    UA_StatusCode connectStatus;
+    UA_Client_getState(client, &channelState, &sessionState, &connectStatus);
+
+    if (sessionState == UA_SESSIONSTATE_ACTIVATED) {
+        reconnect->connecting = false;
+        if (reconnect->state == CONNECTION_CONNECTED) {
+            return;
+        }
+
+        UA_Boolean reactivated = false;
+        UA_NodeId token;
+        UA_ByteString nonce;
+        if (UA_Client_getSessionAuthenticationToken(client, &token, &nonce) == UA_STATUSCODE_GOOD) {
+            reactivated = !UA_NodeId_isNull(&reconnect->sessionToken) && UA_NodeId_equal(&token, &reconnect->sessionToken);
+            UA_NodeId_clear(&reconnect->sessionToken);
+            reconnect->sessionToken = token;
+            UA_ByteString_clear(&nonce);
+        }
+
+        VALUE v_info = rb_hash_new();
+        rb_hash_aset(v_info, ID2SYM(rb_intern("attempts")), UINT2NUM(reconnect->attempt));
+        rb_hash_aset(v_info, ID2SYM(rb_intern("session")), ID2SYM(rb_intern(reactivated ? "reactivated" : "created")));
+
+        reconnect->attempt = 0;
+        reconnect->delay = reconnect->initialDelay;
+        connectionState_notify(self, reconnect, CONNECTION_CONNECTED, v_info);
+        return;
+    }
+
+    if (reconnect->connecting) {
+        if (connectStatus != UA_STATUSCODE_GOOD || channelState == UA_SECURECHANNELSTATE_CLOSED) {
+            reconnect_failed(self, reconnect,
+                             connectStatus != UA_STATUSCODE_GOOD ? connectStatus : UA_STATUSCODE_BADCONNECTIONCLOSED);
+        } else if (UA_DateTime_nowMonotonic() > reconnect->attemptDeadline) {
+            UA_Client_disconnectSecureChannel(client);
+            reconnect_failed(self, reconnect, UA_STATUSCODE_BADTIMEOUT);
+        }
+        return;
+    }
+
+    if (reconnect->state != CONNECTION_CONNECTED) {
+        return;
+    }
+
+    VALUE v_info = rb_hash_new();
+    rb_hash_aset(v_info, ID2SYM(rb_intern("status")), UINT2NUM(connectStatus));
+    if (reconnect->enabled && reconnect->wanted) {
+        reconnect->delay = reconnect->initialDelay;
+        rb_hash_aset(v_info, ID2SYM(rb_intern("retry_in")), DBL2NUM(reconnect_schedule(reconnect)));
+    }
+    connectionState_notify(self, reconnect, CONNECTION_DISCONNECTED, v_info);
+}
+
+/* One step of a lost connection: wait for the next attempt, or start it.
+ * Good while an attempt is in progress, for run_iterate to carry it on. */
+static UA_StatusCode reconnect_run(VALUE self, UA_Client *client) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct Reconnect *reconnect = &ctx->reconnect;
+
+    if (reconnect->connecting) {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    UA_DateTime wait = reconnect->nextAttempt - UA_DateTime_nowMonotonic();
+    if (wait > 0) {
+        /* Block no longer than a regular cycle, and without the GVL */
+        if (wait > UA_DATETIME_SEC) {
+            wait = UA_DATETIME_SEC;
+        }
+        struct timeval tv = { wait / UA_DATETIME_SEC, (wait % UA_DATETIME_SEC) / UA_DATETIME_USEC };
+        rb_thread_wait_for(tv);
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    }
+
+    reconnect->attempt++;
+    VALUE v_info = rb_hash_new();
+    rb_hash_aset(v_info, ID2SYM(rb_intern("attempt")), UINT2NUM(reconnect->attempt));
+    connectionState_notify(self, reconnect, CONNECTION_RECONNECTING, v_info);
+
+    /* With the configured URL and session settings of the last connect */
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    config->noSession = false;
+    UA_StatusCode status = __UA_Client_connect(client, true);
+    if (status != UA_STATUSCODE_GOOD) {
+        reconnect_failed(self, reconnect, status);
+        return status;
+    }
+
+    reconnect->connecting = true;
+    reconnect->attemptDeadline = UA_DateTime_nowMonotonic() + (UA_DateTime)config->timeout * UA_DATETIME_MSEC;
+    return UA_STATUSCODE_GOOD;
+}
+
+static VALUE rb_enableAutoReconnect(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct Reconnect *reconnect = &ctx->reconnect;
+
+    VALUE v_options;
+    rb_scan_args(argc, argv, "0:", &v_options);
+
+    static const char *const names[4] = { "initial_delay", "max_delay", "multiplier", "jitter" };
+    VALUE values[4];
+    keywordsFromRuby(v_options, names, 4, values);
+
+    UA_Double settings[4] = { 0.5, 30.0, 2.0, 0.2 };
+    for (int i = 0; i < 4; i++) {
+        if (values[i] != Qundef) settings[i] = NUM2DBL(values[i]);
+    }
+
+    if (settings[0] <= 0 || settings[1] < settings[0] || settings[2] < 1 || settings[3] < 0 || settings[3] > 1) {
+        rb_raise(rb_eArgError, "expected 0 < initial_delay <= max_delay, multiplier >= 1 and 0 <= jitter <= 1");
+    }
+
+    reconnect->initialDelay = settings[0];
+    reconnect->maxDelay = settings[1];
+    reconnect->multiplier = settings[2];
+    reconnect->jitter = settings[3];
+    reconnect->delay = reconnect->initialDelay;
+    reconnect->enabled = true;
+    UA_Client_getConfig(uclient->client)->noReconnect = true;
+    return Qnil;
+}
+
+static VALUE rb_disableAutoReconnect(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    ctx->reconnect.enabled = false;
+    UA_Client_getConfig(uclient->client)->noReconnect = false;
+    return Qnil;
+}
+
+static VALUE rb_connectionState(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    return connectionStateToSymbol(ctx->reconnect.state);
+}
+
+/* Connection health monitor
+ *
+ * enable_health_monitor registers a repeated callback with the open62541
+ * event loop, so probes go out while run_mon_cycle (or any blocking call)
+ * iterates the client and no Ruby timer is involved. Each probe is an
+ * asynchronous read of Server.ServerStatus.CurrentTime; a probe still
+ * outstanding when the next one is due is not duplicated, it times out
+ * with the configured request timeout instead. A session that delivered
+ * notifications or write results within the interval is alive already, so
+ * no probe is sent. Round trips of the last
+ * HEALTH_WINDOW answers form the RTT histogram. Threshold crossings are
+ * reported to after_health_changed at the end of the cycle, outside the
+ * open62541 callbacks. */
+
+static void health_result(struct HealthMonitor *health, UA_StatusCode status, UA_DateTime rtt) {
+    health->probing = false;
+    health->known = true;
+    health->lastStatus = status;
+
+    if (status != UA_STATUSCODE_GOOD) {
+        health->failures++;
+        health->consecutiveFailures++;
+        if (health->consecutiveFailures >= health->failureThreshold) {
+            health->alive = false;
+        }
+        return;
+    }
+
+    health->consecutiveFailures = 0;
+    health->alive = true;
+    health->lastRtt = rtt;
+    health->samples[health->sampleNext] = rtt;
+    health->sampleNext = (health->sampleNext + 1) % HEALTH_WINDOW;
+    if (health->sampleCount < HEALTH_WINDOW) {
+        health->sampleCount++;
+    }
+    if (health->rttThreshold) {
+        health->slow = rtt > health->rttThreshold;
+    }
+}
+
+static void health_response(UA_Client *client, void *userdata, UA_UInt32 requestId, UA_StatusCode status,
+        UA_DataValue *value) {
+    struct HealthMonitor *health = &((struct OpcuaClientContext *)UA_Client_getContext(client))->health;
+
+    if (status == UA_STATUSCODE_GOOD && value->hasStatus) {
+        status = value->status;
+    }
+    health_result(health, status, UA_DateTime_nowMonotonic() - health->sent);
+}
+
+static void health_probe(UA_Client *client, void *data) {
+    struct HealthMonitor *health = &((struct OpcuaClientContext *)UA_Client_getContext(client))->health;
+    if (health->probing || UA_DateTime_nowMonotonic() - health->lastActivity < health->interval) {
+        return;
+    }
+
+    health->probes++;
+    health->probing = true;
+    health->sent = UA_DateTime_nowMonotonic();
+    UA_StatusCode status = UA_Client_readValueAttribute_async(
+        client, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME), health_response, NULL, NULL);
+    if (status != UA_STATUSCODE_GOOD) {
+        /* Not sent, so the response callback will not run */
+        health_result(health, status, 0);
+    }
+}
+
+/* Reports the crossings since the previous cycle */
+static void health_update(VALUE self, struct HealthMonitor *health) {
+    if (!health->enabled || (health->alive == health->reportedAlive && health->slow == health->reportedSlow)) {
+        return;
+    }
+
+    VALUE callback = rb_ivar_get(self, rb_intern("@callback_after_health_changed"));
+    VALUE v_info = rb_hash_new();
+    rb_hash_aset(v_info, ID2SYM(rb_intern("rtt")),
+                 health->sampleCount ? DBL2NUM((UA_Double)health->lastRtt / UA_DATETIME_SEC) : Qnil);
+    rb_hash_aset(v_info, ID2SYM(rb_intern("consecutive_failures")), UINT2NUM(health->consecutiveFailures));
+    rb_hash_aset(v_info, ID2SYM(rb_intern("status")), UINT2NUM(health->lastStatus));
+
+    const char *events[2] = { NULL, NULL };
+    if (health->alive != health->reportedAlive) {
+        health->reportedAlive = health->alive;
+        events[0] = health->alive ? "up" : "down";
+    }
+    if (health->slow != health->reportedSlow) {
+        health->reportedSlow = health->slow;
+        events[1] = health->slow ? "slow" : "normal";
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (events[i] && !NIL_P(callback)) {
+            VALUE params = rb_ary_new();
+            rb_ary_push(params, ID2SYM(rb_intern(events[i])));
+            rb_ary_push(params, v_info);
+            rb_proc_call(callback, params);
+        }
+    }
+}
+
+/* Fast connect
+ *
+ * connect(url, cached_endpoint: true) remembers, per URL and for the whole
+ * process, the endpoint description (security policy and mode, server
+ * certificate) and anonymous user token policy. The first connect runs the
+ * GetEndpoints that discovery needs anyway itself, picks the endpoint and
+ * hands it to open62541; later connects to the URL reuse it and skip the
+ * round trip. An entry is dropped, and discovery runs again, only when the
+ * server rejects its security settings or certificate. Ruby callbacks can
+ * run while a client connects, so the cache is only touched under a lock.
+ *
+ * session_credentials exports the authentication token and nonce of the
+ * active session; connect(url, session: credentials) activates that session
+ * on a new SecureChannel instead of creating one, as long as the server
+ * still keeps it. */
+
+struct EndpointCacheEntry {
+    char *endpointUrl;
+    UA_EndpointDescription endpoint;
+    UA_UserTokenPolicy userTokenPolicy;
+    struct EndpointCacheEntry *next;
+};
+
+static struct EndpointCacheEntry *endpointCache;
+static VALUE endpointCacheLock;
+
+static struct EndpointCacheEntry *endpointCache_find(const char *endpointUrl) {
+    for (struct EndpointCacheEntry *entry = endpointCache; entry; entry = entry->next) {
+        if (strcmp(entry->endpointUrl, endpointUrl) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void endpointCache_remove(const char *endpointUrl) {
+    rb_mutex_lock(endpointCacheLock);
+    for (struct EndpointCacheEntry **link = &endpointCache; *link; link = &(*link)->next) {
+        struct EndpointCacheEntry *entry = *link;
+        if (strcmp(entry->endpointUrl, endpointUrl) == 0) {
+            *link = entry->next;
+            UA_EndpointDescription_clear(&entry->endpoint);
+            UA_UserTokenPolicy_clear(&entry->userTokenPolicy);
+            UA_free(entry->endpointUrl);
+            UA_free(entry);
+            break;
+        }
+    }
+    rb_mutex_unlock(endpointCacheLock);
+}
+
+/* A concurrent connect may have stored the URL first, the first entry wins */
+static void endpointCache_store(const char *endpointUrl, const UA_EndpointDescription *endpoint,
+        const UA_UserTokenPolicy *userTokenPolicy) {
+    rb_mutex_lock(endpointCacheLock);
+    struct EndpointCacheEntry *entry = endpointCache_find(endpointUrl) ? NULL : UA_calloc(1, sizeof(struct EndpointCacheEntry));
+    size_t length = strlen(endpointUrl);
+    if (entry && (entry->endpointUrl = UA_malloc(length + 1))) {
+        memcpy(entry->endpointUrl, endpointUrl, length + 1);
+        UA_EndpointDescription_copy(endpoint, &entry->endpoint);
+        UA_UserTokenPolicy_copy(userTokenPolicy, &entry->userTokenPolicy);
+        entry->next = endpointCache;
+        endpointCache = entry;
+    } else {
+        UA_free(entry);
+    }
+    rb_mutex_unlock(endpointCacheLock);
+}
+
+/* With nothing set, open62541 runs GetEndpoints again */
+static void endpointConfig_clear(UA_ClientConfig *config) {
+    UA_EndpointDescription_clear(&config->endpoint);
+    UA_UserTokenPolicy_clear(&config->userTokenPolicy);
+}
+
+/* Copies the cached endpoint of the URL into the configuration */
+static UA_Boolean endpointCache_load(UA_ClientConfig *config, const char *endpointUrl) {
+    rb_mutex_lock(endpointCacheLock);
+    struct EndpointCacheEntry *entry = endpointCache_find(endpointUrl);
+    if (entry) {
+        endpointConfig_clear(config);
+        UA_EndpointDescription_copy(&entry->endpoint, &config->endpoint);
+        UA_UserTokenPolicy_copy(&entry->userTokenPolicy, &config->userTokenPolicy);
+    }
+    rb_mutex_unlock(endpointCacheLock);
+    return entry != NULL;
+}
+
+/* Settings a cached endpoint may have gone stale on */
+static UA_Boolean endpointCache_rejected(UA_StatusCode status) {
+    switch (status) {
+        case UA_STATUSCODE_BADSECURITYCHECKSFAILED:
+        case UA_STATUSCODE_BADSECURITYMODEREJECTED:
+        case UA_STATUSCODE_BADSECURITYPOLICYREJECTED:
+        case UA_STATUSCODE_BADIDENTITYTOKENINVALID:
+        case UA_STATUSCODE_BADIDENTITYTOKENREJECTED:
+        case UA_STATUSCODE_BADCERTIFICATEINVALID:
+        case UA_STATUSCODE_BADCERTIFICATETIMEINVALID:
+        case UA_STATUSCODE_BADCERTIFICATEISSUERTIMEINVALID:
+        case UA_STATUSCODE_BADCERTIFICATEHOSTNAMEINVALID:
+        case UA_STATUSCODE_BADCERTIFICATEURIINVALID:
+        case UA_STATUSCODE_BADCERTIFICATEUSENOTALLOWED:
+        case UA_STATUSCODE_BADCERTIFICATEISSUERUSENOTALLOWED:
+        case UA_STATUSCODE_BADCERTIFICATEUNTRUSTED:
+        case UA_STATUSCODE_BADCERTIFICATEREVOCATIONUNKNOWN:
+        case UA_STATUSCODE_BADCERTIFICATEISSUERREVOCATIONUNKNOWN:
+        case UA_STATUSCODE_BADCERTIFICATEREVOKED:
+        case UA_STATUSCODE_BADCERTIFICATEISSUERREVOKED:
+        case UA_STATUSCODE_BADCERTIFICATECHAININCOMPLETE:
+        case UA_STATUSCODE_BADCERTIFICATEPOLICYCHECKFAILED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static UA_Boolean securityPolicySupported(const UA_ClientConfig *config, const UA_String *policyUri) {
+    for (size_t i = 0; i < config->securityPoliciesSize; i++) {
+        if (UA_String_equal(&config->securityPolicies[i].policyUri, policyUri)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Runs the discovery connect would, and caches the endpoint it picks: the
+ * highest security level within the configured security mode and policy,
+ * with a policy the client supports and an anonymous token */
+static void endpointCache_discover(UA_Client *client, const char *endpointUrl) {
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+
+    size_t endpointsSize = 0;
+    UA_EndpointDescription *endpoints = NULL;
+    if (UA_Client_getEndpoints(client, endpointUrl, &endpointsSize, &endpoints) != UA_STATUSCODE_GOOD) {
+        return;
+    }
+
+    const UA_EndpointDescription *selected = NULL;
+    const UA_UserTokenPolicy *selectedToken = NULL;
+    for (size_t i = 0; i < endpointsSize; i++) {
+        const UA_EndpointDescription *endpoint = &endpoints[i];
+        if ((config->securityMode != UA_MESSAGESECURITYMODE_INVALID && endpoint->securityMode != config->securityMode) ||
+            (config->securityPolicyUri.length && !UA_String_equal(&endpoint->securityPolicyUri, &config->securityPolicyUri)) ||
+            !securityPolicySupported(config, &endpoint->securityPolicyUri) ||
+            (selected && endpoint->securityLevel <= selected->securityLevel)) {
+            continue;
+        }
+
+        for (size_t j = 0; j < endpoint->userIdentityTokensSize; j++) {
+            if (endpoint->userIdentityTokens[j].tokenType == UA_USERTOKENTYPE_ANONYMOUS) {
+                selected = endpoint;
+                selectedToken = &endpoint->userIdentityTokens[j];
+                break;
+            }
+        }
+    }
+
+    if (selected) {
+        endpointCache_store(endpointUrl, selected, selectedToken);
+    }
+    UA_Array_delete(endpoints, endpointsSize, &UA_TYPES[UA_TYPES_ENDPOINTDESCRIPTION]);
+}
+
+static UA_StatusCode connectWithSession(UA_Client *client, const char *endpointUrl, const UA_NodeId *token,
+        const UA_ByteString *nonce) {
+    UA_StatusCode status = UA_Client_connectSecureChannel(client, endpointUrl);
+    if (status == UA_STATUSCODE_GOOD) {
+        status = UA_Client_activateSession(client, *token, *nonce);
+    }
+    UA_Client_getConfig(client)->noSession = false;
+
+    if (status != UA_STATUSCODE_GOOD) {
+        /* The server dropped the session, create a new one */
+        status = UA_Client_connect(client, endpointUrl);
+    }
+    return status;
+}
+
+static VALUE rb_sessionCredentials(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+
+    UA_NodeId token;
+    UA_ByteString nonce;
+    UA_StatusCode status = UA_Client_getSessionAuthenticationToken(uclient->client, &token, &nonce);
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+
+    UA_ByteString encoded = UA_BYTESTRING_NULL;
+    status = UA_encodeBinary(&token, &UA_TYPES[UA_TYPES_NODEID], &encoded);
+    UA_NodeId_clear(&token);
+    if (status != UA_STATUSCODE_GOOD) {
+        UA_ByteString_clear(&nonce);
+        return raise_ua_status_error(status);
+    }
+
+    VALUE v_credentials = rb_ary_new_capa(2);
+    rb_ary_push(v_credentials, rb_str_new((const char*)encoded.data, encoded.length));
+    rb_ary_push(v_credentials, rb_str_new((const char*)nonce.data, nonce.length));
+    UA_ByteString_clear(&encoded);
+    UA_ByteString_clear(&nonce);
+    return v_credentials;
+}
+
+static VALUE rb_clearEndpointCache(VALUE klass) {
+    rb_mutex_lock(endpointCacheLock);
+    while (endpointCache) {
+        struct EndpointCacheEntry *entry = endpointCache;
+        endpointCache = entry->next;
+        UA_EndpointDescription_clear(&entry->endpoint);
+        UA_UserTokenPolicy_clear(&entry->userTokenPolicy);
+        UA_free(entry->endpointUrl);
+        UA_free(entry);
+    }
+    rb_mutex_unlock(endpointCacheLock);
+    return Qnil;
+}
+
+static VALUE rb_connect(int argc, VALUE *argv, VALUE self) {
+    VALUE v_connectionString, v_options;
+    rb_scan_args(argc, argv, "1:", &v_connectionString, &v_options);
+
+    if (RB_TYPE_P(v_connectionString, T_STRING) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    char *connectionString = StringValueCStr(v_connectionString);
+
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+
+    static const char *const names[2] = { "cached_endpoint", "session" };
+    VALUE values[2];
+    keywordsFromRuby(v_options, names, 2, values);
+
+    UA_Boolean useCache = values[0] != Qundef && RTEST(values[0]);
+    UA_Boolean reuseSession = values[1] != Qundef && !NIL_P(values[1]);
+
+    UA_NodeId token = UA_NODEID_NULL;
+    UA_ByteString nonce = UA_BYTESTRING_NULL;
+    if (reuseSession) {
+        VALUE v_session = values[1];
+        if (!RB_TYPE_P(v_session, T_ARRAY) || RARRAY_LEN(v_session) != 2 ||
+            !RB_TYPE_P(rb_ary_entry(v_session, 0), T_STRING) || !RB_TYPE_P(rb_ary_entry(v_session, 1), T_STRING)) {
+            return raise_invalid_arguments_error();
+        }
+
+        VALUE v_token = rb_ary_entry(v_session, 0);
+        VALUE v_nonce = rb_ary_entry(v_session, 1);
+        UA_ByteString encoded = { RSTRING_LEN(v_token), (UA_Byte*)RSTRING_PTR(v_token) };
+        if (UA_decodeBinary(&encoded, &token, &UA_TYPES[UA_TYPES_NODEID], NULL) != UA_STATUSCODE_GOOD) {
+            return raise_invalid_arguments_error();
+        }
+        nonce = (UA_ByteString){ RSTRING_LEN(v_nonce), (UA_Byte*)RSTRING_PTR(v_nonce) };
+    }
+
+    /* Without a cached endpoint for this URL, clear the one an earlier
+     * connect left in the configuration, or open62541 would use it */
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    UA_Boolean cached = useCache && endpointCache_load(config, connectionString);
+    UA_Boolean loaded = cached;
+    if (useCache && !cached) {
+        endpointCache_discover(client, connectionString);
+        loaded = endpointCache_load(config, connectionString);
+    }
+    if (!loaded) {
+        endpointConfig_clear(config);
+    }
+
+    UA_StatusCode status = reuseSession ? connectWithSession(client, connectionString, &token, &nonce)
+                                        : UA_Client_connect(client, connectionString);
+
+    if (cached && endpointCache_rejected(status)) {
+        /* The server changed its endpoints, discover them again */
+        endpointCache_remove(connectionString);
+        endpointConfig_clear(config);
+        status = reuseSession ? connectWithSession(client, connectionString, &token, &nonce)
+                              : UA_Client_connect(client, connectionString);
+    }
+    UA_NodeId_clear(&token);
+
+    if (status == UA_STATUSCODE_GOOD) {
+        struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+        ctx->reconnect.wanted = true;
+        connectionState_update(self, client);
+        recoverSubscriptions(self, client);
+        return Qnil;
+    } else {
+        return raise_ua_status_error(status);
+    }
+}
+
+static VALUE rb_createSubscription(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+
+    VALUE v_options;
+    rb_scan_args(argc, argv, "0:", &v_options);
+
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    void *subContext = NULL;
+
+    static const char *const names[6] = {
+        "publishing_interval", "max_notifications_per_publish", "lifetime_count", "keepalive_count", "priority",
+        "timestamps"
+    };
+    VALUE values[6];
+    keywordsFromRuby(v_options, names, 6, values);
+
+    if (values[0] != Qundef) request.requestedPublishingInterval = NUM2DBL(values[0]);
+    if (values[1] != Qundef) request.maxNotificationsPerPublish = NUM2UINT(values[1]);
+    if (values[2] != Qundef) request.requestedLifetimeCount = NUM2UINT(values[2]);
+    if (values[3] != Qundef) request.requestedMaxKeepAliveCount = NUM2UINT(values[3]);
+    if (values[4] != Qundef) request.priority = NUM2UINT(values[4]);
+    if (values[5] != Qundef) subContext = (void*)&subscriptionTimestampFormats[timestampFormatFromSymbol(values[5])];
+
+    UA_CreateSubscriptionResponse response =
+        UA_Client_Subscriptions_create(client, request, subContext, subscriptionStatusChanged, deleteSubscriptionCallback);
+
+    if (response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+        return Qnil;
+    }
+
+    subscriptionStats_add(ctx, &response);
+
+    UA_UInt32 subscriptionId = response.subscriptionId;
+
+    if (ctx->preserveSubscriptions) {
+        subscriptionRecord_add(ctx, subscriptionId, &request, subContext);
+    }
+
+    return UINT2NUM(subscriptionId);
+}
+
+/* Monitored item options
+ *
+ * Both add_monitored_item and add_monitored_items take an optional Hash:
+ * monitoring_mode, sampling_interval, queue_size, discard_oldest, trigger and
+ * absolute_deadband or percent_deadband. The filter lets the server drop
+ * insignificant changes before they are ever published. */
+
+static UA_MonitoringMode monitoringModeFromSymbol(VALUE v_mode) {
+    Check_Type(v_mode, T_SYMBOL);
+    ID mode = SYM2ID(v_mode);
+
+    if (mode == rb_intern("reporting")) {
+        return UA_MONITORINGMODE_REPORTING;
+    } else if (mode == rb_intern("sampling")) {
+        return UA_MONITORINGMODE_SAMPLING;
+    } else if (mode == rb_intern("disabled")) {
+        return UA_MONITORINGMODE_DISABLED;
+    }
+
+    rb_raise(cError, "Unsupported monitoring mode");
+}
+
+static UA_DataChangeTrigger dataChangeTriggerFromSymbol(VALUE v_trigger) {
+    Check_Type(v_trigger, T_SYMBOL);
+    ID trigger = SYM2ID(v_trigger);
+
+    if (trigger == rb_intern("status")) {
+        return UA_DATACHANGETRIGGER_STATUS;
+    } else if (trigger == rb_intern("value")) {
+        return UA_DATACHANGETRIGGER_STATUSVALUE;
+    } else if (trigger == rb_intern("timestamp")) {
+        return UA_DATACHANGETRIGGER_STATUSVALUETIMESTAMP;
+    }
+
+    rb_raise(cError, "Unsupported data change trigger");
+}
+
+/* open62541's defaults, with the client's default queue size */
+static UA_MonitoredItemCreateRequest monitoredItemRequest_default(const struct OpcuaClientContext *ctx, UA_NodeId nodeId) {
+    UA_MonitoredItemCreateRequest request = UA_MonitoredItemCreateRequest_default(nodeId);
+    request.requestedParameters.queueSize = ctx->queueSize;
+    return request;
+}
+
+/* Monitoring parameters given in the options, see monitoredItemRequestFromOptions */
+enum {
+    PARAMETER_SAMPLING_INTERVAL = 1,
+    PARAMETER_QUEUE_SIZE = 2,
+    PARAMETER_DISCARD_OLDEST = 4,
+    PARAMETER_FILTER = 8,
+    PARAMETERS_COMPLETE = PARAMETER_SAMPLING_INTERVAL | PARAMETER_QUEUE_SIZE | PARAMETER_DISCARD_OLDEST
+};
+
+/* Applies the Ruby options Hash (or nil) to a default create request. The
+ * filter, if any, points to *filter, which must outlive the request. Returns
+ * the PARAMETER_ bits of the parameters given. */
+static unsigned monitoredItemRequestFromOptions(UA_MonitoredItemCreateRequest *request, VALUE v_options,
+        UA_DataChangeFilter *filter, VALUE *v_tag) {
+    *v_tag = Qnil;
+    if (NIL_P(v_options)) {
+        return 0;
+    }
+
+    static const char *const names[8] = {
+        "monitoring_mode", "sampling_interval", "queue_size", "discard_oldest", "trigger", "absolute_deadband",
+        "percent_deadband", "tag"
+    };
+    VALUE values[8];
+    keywordsFromRuby(v_options, names, 8, values);
+
+    unsigned given = 0;
+    if (values[7] != Qundef) *v_tag = values[7];
+    if (values[0] != Qundef) request->monitoringMode = monitoringModeFromSymbol(values[0]);
+    if (values[1] != Qundef) {
+        request->requestedParameters.samplingInterval = NUM2DBL(values[1]);
+        given |= PARAMETER_SAMPLING_INTERVAL;
+    }
+    if (values[2] != Qundef) {
+        request->requestedParameters.queueSize = NUM2UINT(values[2]);
+        given |= PARAMETER_QUEUE_SIZE;
+    }
+    if (values[3] != Qundef) {
+        request->requestedParameters.discardOldest = RTEST(values[3]);
+        given |= PARAMETER_DISCARD_OLDEST;
+    }
+
+    if (values[5] != Qundef && values[6] != Qundef) {
+        rb_raise(rb_eArgError, "absolute_deadband and percent_deadband are exclusive");
+    }
+
+    if (values[4] == Qundef && values[5] == Qundef && values[6] == Qundef) {
+        return given;
+    }
+
+    UA_DataChangeFilter_init(filter);
+    filter->trigger = UA_DATACHANGETRIGGER_STATUSVALUE;
+    if (values[4] != Qundef) {
+        filter->trigger = dataChangeTriggerFromSymbol(values[4]);
+    }
+    if (values[5] != Qundef) {
+        filter->deadbandType = UA_DEADBANDTYPE_ABSOLUTE;
+        filter->deadbandValue = NUM2DBL(values[5]);
+    } else if (values[6] != Qundef) {
+        filter->deadbandType = UA_DEADBANDTYPE_PERCENT;
+        filter->deadbandValue = NUM2DBL(values[6]);
+    }
+
+    UA_ExtensionObject_setValueNoDelete(&request->requestedParameters.filter, filter,
+                                        &UA_TYPES[UA_TYPES_DATACHANGEFILTER]);
+    return given | PARAMETER_FILTER;
+}
+
+static VALUE rb_addMonitoredItem(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+
+    VALUE v_subscriptionId, v_monNsIndex, v_monNsName, v_options;
+    rb_scan_args(argc, argv, "31", &v_subscriptionId, &v_monNsIndex, &v_monNsName, &v_options);
+
+    UA_UInt32 subscriptionId = NUM2UINT(v_subscriptionId); // TODO: check type
+    UA_UInt16 monNsIndex = NUM2USHORT(v_monNsIndex); // TODO: check type
+    char* monNsName = StringValueCStr(v_monNsName); // TODO: check type
+
+    UA_MonitoredItemCreateRequest monRequest =
+        monitoredItemRequest_default(UA_Client_getContext(client), UA_NODEID_STRING(monNsIndex, monNsName));
+    UA_DataChangeFilter filter;
+    VALUE v_tag;
+    monitoredItemRequestFromOptions(&monRequest, v_options, &filter, &v_tag);
+    VALUE v_handler = rb_block_given_p() ? rb_block_proc() : Qnil;
+
+    if (!staleness_reserve(UA_Client_getContext(client), 1)) {
+        return raise_ua_status_error(UA_STATUSCODE_BADOUTOFMEMORY);
+    }
+    writeShadow_watch(&((struct OpcuaClientContext *)UA_Client_getContext(client))->writeShadow,
+                      &monRequest.itemToMonitor.nodeId);
+
+    struct MonitoredItemContext *item =
+        monitoredItemContext_new(UA_Client_getContext(client), &monRequest.itemToMonitor.nodeId, v_handler, v_tag);
+    if (!item) {
+        return raise_ua_status_error(UA_STATUSCODE_BADOUTOFMEMORY);
+    }
+
+    UA_MonitoredItemCreateResult monResponse =
+    UA_Client_MonitoredItems_createDataChange(client, subscriptionId,
+                                              UA_TIMESTAMPSTORETURN_BOTH,
+                                              monRequest, item, handler_dataChanged, monitoredItemDeleted);
+    if (monResponse.statusCode == UA_STATUSCODE_GOOD) {
+        // printf("Request to monitor field %hu:%s successful, id %u\n", monNsIndex, monNsName, monResponse.monitoredItemId);
+        UA_UInt32 monitoredItemId = monResponse.monitoredItemId;
+
+        if (monRequest.monitoringMode == UA_MONITORINGMODE_REPORTING) {
+            staleness_track(UA_Client_getContext(client), item, subscriptionId, monitoredItemId,
+                            monResponse.revisedSamplingInterval);
+        }
+
+        struct SubscriptionRecord *record = subscriptionRecord_find(UA_Client_getContext(client), subscriptionId);
+        if (record) {
+            subscriptionRecord_addItem(record, &monRequest, monitoredItemId, v_handler, v_tag);
+        }
+
+        return UINT2NUM(monitoredItemId);
+    } else {
+        // printf("Request to monitor field failed: %s\n", UA_StatusCode_name(monResponse.statusCode));
+        return Qnil;
+    }
+}
+
+static VALUE rb_disconnect(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    ctx->reconnect.wanted = false;
+    ctx->reconnect.connecting = false;
+
+    UA_StatusCode status = UA_Client_disconnect(client);
+    connectionState_update(self, client);
+    return RB_UINT2NUM(status);
+}
+
+/* Server operation limits
+ *
+ * Read once per session from Server.ServerCapabilities(.OperationLimits) and
+ * used to chunk batch requests and size managed subscriptions. Zero means
+ * the server reports no limit. */
+
+static void readOperationLimits(UA_Client *client, struct OperationLimits *limits) {
+    if (limits->read) {
+        return;
+    }
+
+    const UA_UInt32 ids[3] = {
+        UA_NS0ID_SERVER_SERVERCAPABILITIES_OPERATIONLIMITS_MAXNODESPERWRITE,
+        UA_NS0ID_SERVER_SERVERCAPABILITIES_OPERATIONLIMITS_MAXMONITOREDITEMSPERCALL,
+        UA_NS0ID_SERVER_SERVERCAPABILITIES_MAXMONITOREDITEMSPERSUBSCRIPTION
+    };
+
+    UA_ReadValueId rValues[3];
+    for (int i=0; i<3; i++) {
+        UA_ReadValueId_init(&rValues[i]);
+        rValues[i].nodeId = UA_NODEID_NUMERIC(0, ids[i]);
+        rValues[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = rValues;
+    request.nodesToReadSize = 3;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+
+    if (response.responseHeader.serviceResult == UA_STATUSCODE_GOOD && response.resultsSize == 3) {
+        UA_UInt32 *fields[3] = {
+            &limits->maxNodesPerWrite, &limits->maxMonitoredItemsPerCall, &limits->maxMonitoredItemsPerSubscription
+        };
+
+        for (int i=0; i<3; i++) {
+            const UA_DataValue *result = &response.results[i];
+            *fields[i] = 0;
+            if (result->hasValue && UA_Variant_hasScalarType(&result->value, &UA_TYPES[UA_TYPES_UINT32])) {
+                *fields[i] = *(UA_UInt32*)result->value.data;
+            }
+        }
+
+        limits->read = true;
+    }
+
+    UA_ReadResponse_clear(&response);
+}
+
+/* Items per request: the smaller of the server limit and the client chunk size */
+static size_t chunkSize(UA_UInt32 serverLimit, size_t clientLimit) {
+    if (serverLimit > 0 && (clientLimit == 0 || serverLimit < clientLimit)) {
+        return serverLimit;
+    }
+    return clientLimit;
+}
+
+static VALUE rb_operationLimits(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    readOperationLimits(uclient->client, &ctx->operationLimits);
+
+    VALUE limits = rb_hash_new();
+    rb_hash_aset(limits, ID2SYM(rb_intern("max_nodes_per_write")), UINT2NUM(ctx->operationLimits.maxNodesPerWrite));
+    rb_hash_aset(limits, ID2SYM(rb_intern("max_monitored_items_per_call")),
+                 UINT2NUM(ctx->operationLimits.maxMonitoredItemsPerCall));
+    rb_hash_aset(limits, ID2SYM(rb_intern("max_monitored_items_per_subscription")),
+                 UINT2NUM(ctx->operationLimits.maxMonitoredItemsPerSubscription));
+    return limits;
+}
+
+static UA_StatusCode multiRead(struct RequestArena *arena, UA_Client *client, const UA_NodeId *nodeId, UA_Variant *out, const long varsCount) {
+
+    UA_UInt16 rvSize = UA_TYPES[UA_TYPES_READVALUEID].memSize;
+    UA_ReadValueId *rValues = requestArena_alloc(arena, varsCount, rvSize);
+
+    for (int i=0; i<varsCount; i++) {
+        UA_ReadValueId *readItem = &rValues[i];
+        readItem->nodeId = nodeId[i];
+        readItem->attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = rValues;
+    request.nodesToReadSize = varsCount;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD) {
+        if(response.resultsSize == varsCount)
+            retval = response.results[0].status;
+        else
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_ReadResponse_clear(&response);
+        return retval;
+    }
+
+    /* Set the StatusCode */
+    UA_DataValue *results = response.results;
+
+    if (response.resultsSize != varsCount) {
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+        UA_ReadResponse_clear(&response);
+        return retval;
+    }
+
+    for (int i=0; i<varsCount; i++) {
+        if ((results[i].hasStatus && results[i].status != UA_STATUSCODE_GOOD) || !results[i].hasValue) {
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+            UA_ReadResponse_clear(&response);
+            return retval;
+        }
+    }
+
+    for (int i=0; i<varsCount; i++) {
+        out[i] = results[i].value;
+        UA_Variant_init(&results[i].value);
+    }
+
+    UA_ReadResponse_clear(&response);
+    return retval;
+}
+
+static UA_StatusCode multiWrite(struct RequestArena *arena, UA_Client *client, const UA_NodeId *nodeId, const UA_Variant *in, const long varsSize) {
+    UA_AttributeId attributeId = UA_ATTRIBUTEID_VALUE;
+
+    UA_UInt16 wvSize = UA_TYPES[UA_TYPES_WRITEVALUE].memSize;
+
+    UA_WriteValue *wValues = requestArena_alloc(arena, varsSize, wvSize);
+
+    for (int i=0; i<varsSize; i++) {
+        UA_WriteValue *wValue = &wValues[i];
+        wValue->attributeId = attributeId;
+        wValue->nodeId = nodeId[i];
+        wValue->value.value = in[i];
+        wValue->value.hasValue = true;
+    }
+
+    UA_WriteRequest wReq;
+    UA_WriteRequest_init(&wReq);
+    wReq.nodesToWrite = wValues;
+    wReq.nodesToWriteSize = varsSize;
+
+    UA_WriteResponse wResp = UA_Client_Service_write(client, wReq);
+
+    UA_StatusCode retval = wResp.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD) {
+        if(wResp.resultsSize == varsSize) {
+            retval = wResp.results[0];
+
+            for (int i=0; i<wResp.resultsSize; i++) {
+                if (wResp.results[i] != UA_STATUSCODE_GOOD) {
+                    retval = wResp.results[i];
+                    // printf("%s\n", "multiWrite: bad result found");
+                    break;
+                }
+            }
+
+            if (retval == UA_STATUSCODE_GOOD) {
+                // printf("%s\n", "multiWrite: all vars written");
+            }
+        } else {
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+            // printf("%s\n", "multiWrite: bad resultsSize");
+        }
+    } else {
+        // printf("%s\n", "multiWrite: bad write");
+    }
+
+    UA_WriteResponse_clear(&wResp);
+
+    return retval;
+}
+
+static VALUE readUaValues_body(struct RequestCall *call) {
+    VALUE v_nsIndex = call->argv[0];
+    VALUE v_aryNames = call->argv[1];
+    VALUE v_format = call->argv[2];
+
+    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    Check_Type(v_aryNames, T_ARRAY);
+    const long namesCount = RARRAY_LEN(v_aryNames);
+
+    int nsIndex = FIX2INT(v_nsIndex);
+
+    UA_UInt16 nidSize = UA_TYPES[UA_TYPES_NODEID].memSize;
+
+    UA_NodeId *nodes = requestArena_alloc(&call->arena, namesCount, nidSize);
+    UA_Variant *readValues = requestArena_allocTyped(&call->arena, namesCount, &UA_TYPES[UA_TYPES_VARIANT]);
+
+    for (int i=0; i<namesCount; i++) {
+        VALUE v_name = rb_ary_entry(v_aryNames, i);
+
+        if (RB_TYPE_P(v_name, T_STRING) != 1) {
+            return raise_invalid_arguments_error();
+        }
+
+        char *name = StringValueCStr(v_name);
+        nodes[i] = UA_NODEID_STRING(nsIndex, name);
+    }
+
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    enum TimestampFormat format = NIL_P(v_format) ? ctx->timestampFormat : timestampFormatFromSymbol(v_format);
+
+    UA_StatusCode status = multiRead(&call->arena, call->client, nodes, readValues, namesCount);
+
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+
+    VALUE resultArray = rb_ary_new2(namesCount);
+
+    for (int i=0; i<namesCount; i++) {
+        // printf("the value is: %i\n", val);
+
+        VALUE rubyVal = variantScalarToRuby(&readValues[i], format);
+
+        rb_ary_push(resultArray, rubyVal);
+    }
+
+    return resultArray;
+}
+
+static VALUE rb_readUaValues(int argc, VALUE *argv, VALUE self) {
+    VALUE v_nsIndex, v_aryNames, v_options;
+    rb_scan_args(argc, argv, "2:", &v_nsIndex, &v_aryNames, &v_options);
+
+    static const char *const names[1] = { "timestamps" };
+    VALUE v_format;
+    keywordsFromRuby(v_options, names, 1, &v_format);
+
+    const VALUE args[] = { v_nsIndex, v_aryNames, v_format == Qundef ? Qnil : v_format };
+    return withRequestArena(self, readUaValues_body, args, 0);
+}
+
+/* Strict type check for values passed to the multi_write_* methods */
+static void checkUaScalarType(VALUE v_value, int uaType) {
+    switch (uaType) {
+        case UA_TYPES_BYTE: case UA_TYPES_SBYTE:
+        case UA_TYPES_INT16: case UA_TYPES_UINT16:
+        case UA_TYPES_INT32: case UA_TYPES_UINT32:
+        case UA_TYPES_INT64: case UA_TYPES_UINT64:
+            Check_Type(v_value, T_FIXNUM);
+            break;
+        case UA_TYPES_FLOAT: case UA_TYPES_DOUBLE:
+            Check_Type(v_value, T_FLOAT);
+            break;
+        case UA_TYPES_BOOLEAN:
+            if (RB_TYPE_P(v_value, T_TRUE) != 1 && RB_TYPE_P(v_value, T_FALSE) != 1) {
+                raise_invalid_arguments_error();
+            }
+            break;
+        default:
+            rb_raise(cError, "Unsupported type");
+    }
+}
+
+/* Convert a Ruby value into a scalar of the given UA type stored at dst.
+ * Strings are borrowed, the caller keeps v_value alive while dst is used. */
+static void rubyToUaScalar(VALUE v_value, int uaType, void *dst) {
+    if (uaType == UA_TYPES_BYTE) {
+        *(UA_Byte*)dst = NUM2CHR(v_value);
+    } else if (uaType == UA_TYPES_SBYTE) {
+        *(UA_SByte*)dst = NUM2INT(v_value);
+    } else if (uaType == UA_TYPES_INT16) {
+        *(UA_Int16*)dst = NUM2SHORT(v_value);
+    } else if (uaType == UA_TYPES_UINT16) {
+        *(UA_UInt16*)dst = NUM2USHORT(v_value);
+    } else if (uaType == UA_TYPES_INT32) {
+        *(UA_Int32*)dst = NUM2INT(v_value);
+    } else if (uaType == UA_TYPES_UINT32) {
+        *(UA_UInt32*)dst = NUM2UINT(v_value);
+    } else if (uaType == UA_TYPES_INT64) {
+        *(UA_Int64*)dst = NUM2LL(v_value);
+    } else if (uaType == UA_TYPES_UINT64) {
+        *(UA_UInt64*)dst = NUM2ULL(v_value);
+    } else if (uaType == UA_TYPES_FLOAT) {
+        *(UA_Float*)dst = NUM2DBL(v_value);
+    } else if (uaType == UA_TYPES_DOUBLE) {
+        *(UA_Double*)dst = NUM2DBL(v_value);
+    } else if (uaType == UA_TYPES_BOOLEAN) {
+        *(UA_Boolean*)dst = RTEST(v_value);
+    } else if (uaType == UA_TYPES_STRING) {
+        if (RB_TYPE_P(v_value, T_STRING) != 1) {
+            raise_invalid_arguments_error();
+        }
+        char *str = StringValueCStr(v_value);
+        UA_String *uaString = dst;
+        uaString->length = RSTRING_LEN(v_value);
+        uaString->data = (UA_Byte*)str;
+    } else {
+        rb_raise(cError, "Unsupported type");
+    }
+}
+
+static VALUE writeUaValues_body(struct RequestCall *call) {
+    VALUE v_nsIndex = call->argv[0];
+    VALUE v_aryNames = call->argv[1];
+    VALUE v_aryNewValues = call->argv[2];
+    int uaType = call->uaType;
+
+    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    Check_Type(v_aryNames, T_ARRAY);
+    Check_Type(v_aryNewValues, T_ARRAY);
+
+    const long namesCount = RARRAY_LEN(v_aryNames);
+    const long valuesCount = RARRAY_LEN(v_aryNewValues);
+
+    if (namesCount != valuesCount) {
+        return raise_invalid_arguments_error();
+    }
+
+    if (uaType == UA_TYPES_STRING) {
+        rb_raise(cError, "Unsupported type");
+    }
+
+    int nsIndex = FIX2INT(v_nsIndex);
+    const UA_DataType *type = &UA_TYPES[uaType];
+
+    UA_UInt16 nidSize = UA_TYPES[UA_TYPES_NODEID].memSize;
+    UA_UInt16 variantSize = UA_TYPES[UA_TYPES_VARIANT].memSize;
+
+    UA_NodeId *nodes = requestArena_alloc(&call->arena, namesCount, nidSize);
+    UA_Variant *values = requestArena_alloc(&call->arena, namesCount, variantSize);
+    char *scalars = requestArena_alloc(&call->arena, namesCount, type->memSize);
+
+    for (int i=0; i<namesCount; i++) {
+        VALUE v_name = rb_ary_entry(v_aryNames, i);
+        VALUE v_newValue = rb_ary_entry(v_aryNewValues, i);
+
+        if (RB_TYPE_P(v_name, T_STRING) != 1) {
+            return raise_invalid_arguments_error();
+        }
+
+        char *name = StringValueCStr(v_name);
         nodes[i] = UA_NODEID_STRING(nsIndex, name);
 
-        if (uaType == UA_TYPES_BYTE) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_Byte newValue = NUM2CHR(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Byte));
-            *(UA_Byte*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_SBYTE) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_SByte newValue = NUM2INT(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_SByte));
-            *(UA_SByte*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_UINT16) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_UInt16 newValue = NUM2USHORT(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_UInt16));
-            *(UA_UInt16*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_INT16) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_Int16 newValue = NUM2SHORT(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Int16));
-            *(UA_Int16*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_UINT32) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_UInt32 newValue = NUM2UINT(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_UInt32));
-            *(UA_UInt32*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_INT32) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_Int32 newValue = NUM2INT(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Int32));
-            *(UA_Int32*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_INT64) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_Int64 newValue = NUM2LL(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Int64));
-            *(UA_Int64*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_UINT64) {
-            Check_Type(v_newValue, T_FIXNUM);
-            UA_UInt64 newValue = NUM2ULL(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_UInt64));
-            *(UA_UInt64*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_FLOAT) {
-            Check_Type(v_newValue, T_FLOAT);
-            UA_Float newValue = NUM2DBL(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Float));
-            *(UA_Float*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_DOUBLE) {
-            Check_Type(v_newValue, T_FLOAT);
-            UA_Double newValue = NUM2DBL(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Double));
-            *(UA_Double*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[uaType];
-        } else if (uaType == UA_TYPES_BOOLEAN) {
-            if (RB_TYPE_P(v_newValue, T_TRUE) != 1 && RB_TYPE_P(v_newValue, T_FALSE) != 1) {
-                return raise_invalid_arguments_error();
+        checkUaScalarType(v_newValue, uaType);
+        rubyToUaScalar(v_newValue, uaType, scalars + i * type->memSize);
+        values[i].data = scalars + i * type->memSize;
+        values[i].type = type;
+        values[i].storageType = UA_VARIANT_DATA_NODELETE;
+    }
+
+    /* Drop the writes the shadow already has */
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    long sendCount = 0;
+
+    for (long i=0; i<namesCount; i++) {
+        if (!writeShadow_matches(&ctx->writeShadow, &nodes[i], &values[i])) {
+            nodes[sendCount] = nodes[i];
+            values[sendCount] = values[i];
+            sendCount++;
+        }
+    }
+
+    if (sendCount == 0) {
+        writeShadow_count(&ctx->writeShadow, namesCount, 0);
+        return Qnil;
+    }
+
+    UA_StatusCode status = multiWrite(&call->arena, call->client, nodes, values, sendCount);
+
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+
+    writeShadow_count(&ctx->writeShadow, namesCount - sendCount, sendCount);
+    for (long i=0; i<sendCount; i++) {
+        writeShadow_store(&ctx->writeShadow, &nodes[i], &values[i]);
+    }
+
+    return Qnil;
+}
+
+static VALUE rb_writeUaValues(VALUE self, VALUE v_nsIndex, VALUE v_aryNames, VALUE v_aryNewValues, int uaType) {
+    const VALUE argv[] = { v_nsIndex, v_aryNames, v_aryNewValues };
+    return withRequestArena(self, writeUaValues_body, argv, uaType);
+}
+
+static VALUE rb_writeUaValue(VALUE self, VALUE v_nsIndex, VALUE v_name, VALUE v_newValue, int uaType) {
+    if (RB_TYPE_P(v_name, T_STRING) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    if (uaType == UA_TYPES_INT16 && RB_TYPE_P(v_newValue, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    char *name = StringValueCStr(v_name);
+    int nsIndex = FIX2INT(v_nsIndex);
+
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+
+    /* Scalars live on the stack, the variant only borrows them */
+    union {
+        UA_Int64 i64;
+        UA_UInt64 u64;
+        UA_Double dbl;
+        UA_String str;
+    } scalar;
+
+    rubyToUaScalar(v_newValue, uaType, &scalar);
+
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &scalar, &UA_TYPES[uaType]);
+    value.storageType = UA_VARIANT_DATA_NODELETE;
+
+    UA_NodeId nodeId = UA_NODEID_STRING(nsIndex, name);
+    if (writeShadow_matches(&ctx->writeShadow, &nodeId, &value)) {
+        writeShadow_count(&ctx->writeShadow, 1, 0);
+        return Qnil;
+    }
+
+    UA_StatusCode status = UA_Client_writeValueAttribute(client, nodeId, &value);
+
+    if (status == UA_STATUSCODE_GOOD) {
+        writeShadow_count(&ctx->writeShadow, 0, 1);
+        writeShadow_store(&ctx->writeShadow, &nodeId, &value);
+    }
+    RB_GC_GUARD(v_newValue);
+
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+
+    return Qnil;
+}
+
+/* Shallow WriteValues borrowing the queued nodes and values, leaving out the
+ * writes the shadow already has. Returns the number of WriteValues. */
+static size_t writeQueue_fillRequest(const struct WriteQueue *queue, const struct WriteShadow *shadow, UA_WriteValue *wValues) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < queue->index.count; i++) {
+        if (writeShadow_matches(shadow, &queue->index.keys[i], &queue->values[i].value)) {
+            continue;
+        }
+
+        wValues[count].attributeId = UA_ATTRIBUTEID_VALUE;
+        wValues[count].nodeId = queue->index.keys[i];
+        wValues[count].value = queue->values[i];
+        count++;
+    }
+
+    return count;
+}
+
+/* Status of WriteValue i in a WriteResponse */
+static UA_StatusCode writeResultStatus(const UA_WriteResponse *wResp, size_t count, size_t i) {
+    UA_StatusCode status = wResp->responseHeader.serviceResult;
+    if (status == UA_STATUSCODE_GOOD) {
+        status = wResp->resultsSize == count ? wResp->results[i] : UA_STATUSCODE_BADUNEXPECTEDERROR;
+    }
+    return status;
+}
+
+/* [[ns, name, status], ...] for the nodes of a WriteRequest */
+static VALUE writeResultsToRuby(const UA_WriteValue *wValues, size_t count, const UA_WriteResponse *wResp) {
+    VALUE results = rb_ary_new2(count);
+
+    for (size_t i = 0; i < count; i++) {
+        const UA_NodeId *nodeId = &wValues[i].nodeId;
+        rb_ary_push(results, rb_ary_new_from_args(3,
+            UINT2NUM(nodeId->namespaceIndex), nodeIdIdentifierToRuby(nodeId),
+            UINT2NUM(writeResultStatus(wResp, count, i))));
+    }
+
+    return results;
+}
+
+/* Remember the values that were written successfully */
+static void writeResultsToShadow(struct WriteShadow *shadow, const UA_WriteValue *wValues, size_t count, const UA_WriteResponse *wResp) {
+    for (size_t i = 0; i < count; i++) {
+        if (writeResultStatus(wResp, count, i) == UA_STATUSCODE_GOOD) {
+            writeShadow_store(shadow, &wValues[i].nodeId, &wValues[i].value.value);
+        }
+    }
+}
+
+/* Keeps the response for writeQueue_deliver, Ruby is not called from here */
+static void writeQueue_flushed(UA_Client *client, void *userdata, UA_UInt32 requestId, UA_WriteResponse *wResp) {
+    struct WriteFlushInFlight *flight = userdata;
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct WriteQueue *queue = &ctx->writeQueue;
+
+    if (ctx->deleting) {
+        writeFlight_free(flight);
+        return;
+    }
+
+    /* Timeouts and closed connections are reported by the client itself */
+    if (wResp->responseHeader.serviceResult == UA_STATUSCODE_GOOD) {
+        health_activity(&ctx->health, UA_DateTime_nowMonotonic());
+    }
+
+    if (UA_WriteResponse_copy(wResp, &flight->response) != UA_STATUSCODE_GOOD) {
+        UA_WriteResponse_clear(&flight->response);
+        flight->response.responseHeader.serviceResult = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    if (flight->response.responseHeader.serviceResult == UA_STATUSCODE_GOOD) {
+        writeShadow_count(&ctx->writeShadow, flight->skipped, flight->count);
+    }
+
+    struct WriteFlushInFlight **tail = &queue->flushed;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = flight;
+}
+
+/* Hands the answered timer flushes to the shadow and after_writes_flushed,
+ * in order */
+static void writeQueue_deliver(VALUE self, struct OpcuaClientContext *ctx) {
+    struct WriteQueue *queue = &ctx->writeQueue;
+
+    while (queue->flushed) {
+        struct WriteFlushInFlight *flight = queue->flushed;
+        queue->flushed = flight->next;
+
+        writeResultsToShadow(&ctx->writeShadow, flight->writes, flight->count, &flight->response);
+        VALUE results = writeResultsToRuby(flight->writes, flight->count, &flight->response);
+        writeFlight_free(flight);
+
+        VALUE callback = rb_ivar_get(self, rb_intern("@callback_after_writes_flushed"));
+        if (!NIL_P(callback)) {
+            VALUE params = rb_ary_new();
+            rb_ary_push(params, results);
+            rb_proc_call(callback, params);
+        }
+    }
+}
+
+/* Repeated callback: dispatch the queue asynchronously. Writes stay queued
+ * if the request cannot be sent (e.g. while disconnected). */
+static void writeQueue_timer(UA_Client *client, void *data) {
+    struct OpcuaClientContext *ctx = data;
+    struct WriteQueue *queue = &ctx->writeQueue;
+
+    if (queue->index.count == 0) {
+        return;
+    }
+
+    UA_WriteValue *wValues = UA_calloc(queue->index.count, sizeof(UA_WriteValue));
+    if (!wValues) {
+        return;
+    }
+
+    size_t count = writeQueue_fillRequest(queue, &ctx->writeShadow, wValues);
+    if (count == 0) {
+        writeShadow_count(&ctx->writeShadow, queue->index.count, 0);
+        UA_free(wValues);
+        writeQueue_clear(queue);
+        return;
+    }
+
+    /* The response callback needs the nodes and values that were sent */
+    struct WriteFlushInFlight *flight = UA_calloc(1, sizeof(struct WriteFlushInFlight));
+    if (!flight ||
+        UA_Array_copy(wValues, count, (void**)&flight->writes, &UA_TYPES[UA_TYPES_WRITEVALUE]) != UA_STATUSCODE_GOOD) {
+        UA_free(flight);
+        UA_free(wValues);
+        return;
+    }
+    flight->count = count;
+    flight->skipped = queue->index.count - count;
+
+    UA_WriteRequest wReq;
+    UA_WriteRequest_init(&wReq);
+    wReq.nodesToWrite = wValues;
+    wReq.nodesToWriteSize = count;
+
+    UA_StatusCode status = UA_Client_sendAsyncWriteRequest(client, &wReq, writeQueue_flushed, flight, NULL);
+    UA_free(wValues);
+
+    if (status != UA_STATUSCODE_GOOD) {
+        writeFlight_free(flight);
+        return;
+    }
+
+    writeQueue_clear(queue);
+    queue->flushes++;
+}
+
+struct WriteQueueInsert {
+    struct NodeMap *index;
+    UA_NodeId nodeId;
+    UA_Boolean inserted;
+};
+
+/* nodeMap_insert for rb_protect, which may raise on allocation */
+static VALUE writeQueue_insertNode(VALUE v_insert) {
+    struct WriteQueueInsert *insert = (struct WriteQueueInsert *)v_insert;
+    return SIZET2NUM(nodeMap_insert(insert->index, &insert->nodeId, &insert->inserted));
+}
+
+static VALUE rb_enqueueWrite(VALUE self, VALUE v_nsIndex, VALUE v_name, VALUE v_newValue, VALUE v_type) {
+    if (RB_TYPE_P(v_name, T_STRING) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    int uaType = uaTypeFromSymbol(v_type);
+    char *name = StringValueCStr(v_name);
+    int nsIndex = FIX2INT(v_nsIndex);
+
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct WriteQueue *queue = &ctx->writeQueue;
+
+    union {
+        UA_Int64 i64;
+        UA_UInt64 u64;
+        UA_Double dbl;
+        UA_String str;
+    } scalar;
+
+    rubyToUaScalar(v_newValue, uaType, &scalar);
+
+    /* Room for one more node first, so the index never points past values */
+    if (queue->capacity <= queue->index.count) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 32;
+        REALLOC_N(queue->values, UA_DataValue, capacity);
+        memset(&queue->values[queue->capacity], 0, (capacity - queue->capacity) * sizeof(UA_DataValue));
+        queue->capacity = capacity;
+    }
+
+    /* The queued value is replaced only once its successor exists */
+    struct WriteQueueInsert insert = { &queue->index, UA_NODEID_STRING(nsIndex, name), false };
+    UA_DataValue dataValue;
+    UA_DataValue_init(&dataValue);
+    UA_StatusCode status = UA_Variant_setScalarCopy(&dataValue.value, &scalar, &UA_TYPES[uaType]);
+    RB_GC_GUARD(v_newValue);
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+    dataValue.hasValue = true;
+
+    int state = 0;
+    size_t index = NUM2SIZET(rb_protect(writeQueue_insertNode, (VALUE)&insert, &state));
+    if (state) {
+        UA_DataValue_clear(&dataValue);
+        rb_jump_tag(state);
+    }
+
+    UA_DataValue_clear(&queue->values[index]);
+    queue->values[index] = dataValue;
+
+    queue->enqueued++;
+    if (!insert.inserted) {
+        queue->coalesced++;
+    }
+
+    return ULONG2NUM(queue->index.count);
+}
+
+static VALUE flushWrites_body(struct RequestCall *call) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    struct WriteQueue *queue = &ctx->writeQueue;
+    size_t count = queue->index.count;
+
+    if (count == 0) {
+        return rb_ary_new();
+    }
+
+    UA_WriteValue *wValues = requestArena_alloc(&call->arena, count, sizeof(UA_WriteValue));
+    count = writeQueue_fillRequest(queue, &ctx->writeShadow, wValues);
+    size_t skipped = queue->index.count - count;
+
+    if (count == 0) {
+        writeShadow_count(&ctx->writeShadow, skipped, 0);
+        writeQueue_clear(queue);
+        return rb_ary_new();
+    }
+
+    UA_WriteRequest wReq;
+    UA_WriteRequest_init(&wReq);
+    wReq.nodesToWrite = wValues;
+    wReq.nodesToWriteSize = count;
+
+    UA_WriteResponse *wResp = requestArena_allocTyped(&call->arena, 1, &UA_TYPES[UA_TYPES_WRITERESPONSE]);
+    *wResp = UA_Client_Service_write(call->client, wReq);
+
+    if (wResp->responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+        /* Nothing was written, keep the queue for the next flush */
+        return raise_ua_status_error(wResp->responseHeader.serviceResult);
+    }
+
+    writeShadow_count(&ctx->writeShadow, skipped, count);
+    writeResultsToShadow(&ctx->writeShadow, wValues, count, wResp);
+    VALUE results = writeResultsToRuby(wValues, count, wResp);
+
+    writeQueue_clear(queue);
+    queue->flushes++;
+
+    return results;
+}
+
+static VALUE rb_flushWrites(VALUE self) {
+    return withRequestArena(self, flushWrites_body, NULL, 0);
+}
+
+static VALUE rb_autoFlushWrites(VALUE self, VALUE v_intervalMs) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct WriteQueue *queue = &ctx->writeQueue;
+
+    UA_Double intervalMs = NIL_P(v_intervalMs) ? 0 : NUM2DBL(v_intervalMs);
+
+    if (intervalMs <= 0) {
+        if (queue->timerId) {
+            UA_Client_removeCallback(client, queue->timerId);
+            queue->timerId = 0;
+        }
+        return Qnil;
+    }
+
+    UA_StatusCode status;
+    if (queue->timerId) {
+        status = UA_Client_changeRepeatedCallbackInterval(client, queue->timerId, intervalMs);
+    } else {
+        status = UA_Client_addRepeatedCallback(client, writeQueue_timer, ctx, intervalMs, &queue->timerId);
+    }
+
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+
+    return Qnil;
+}
+
+static VALUE rb_writeQueueStats(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct WriteQueue *queue = &ctx->writeQueue;
+
+    VALUE stats = rb_hash_new();
+    rb_hash_aset(stats, ID2SYM(rb_intern("pending")), ULONG2NUM(queue->index.count));
+    rb_hash_aset(stats, ID2SYM(rb_intern("enqueued")), ULL2NUM(queue->enqueued));
+    rb_hash_aset(stats, ID2SYM(rb_intern("coalesced")), ULL2NUM(queue->coalesced));
+    rb_hash_aset(stats, ID2SYM(rb_intern("flushes")), ULL2NUM(queue->flushes));
+    return stats;
+}
+
+/* Timestamped batch writes
+ *
+ * multi_write_data_values writes full DataValues (value, source timestamp,
+ * status) for a series of points. Values, timestamps and statuses can be
+ * packed Strings, which are encoded straight from their memory, so large
+ * backfills do not build one Ruby object per point. */
+
+/* UA_DateTime from a Time or an Integer of nanoseconds since the Unix epoch */
+static UA_DateTime rubyToUaDateTime(VALUE v_time) {
+    if (RB_INTEGER_TYPE_P(v_time)) {
+        return UA_DATETIME_UNIX_EPOCH + NUM2LL(v_time) / 100;
+    }
+
+    struct timespec ts = rb_time_timespec(v_time);
+    return UA_DATETIME_UNIX_EPOCH + (UA_DateTime)ts.tv_sec * UA_DATETIME_SEC + ts.tv_nsec / 100;
+}
+
+/* Element count of a packed String, or of an Array */
+static long packedOrArrayLength(VALUE v_values, size_t elementSize, const char *what) {
+    if (RB_TYPE_P(v_values, T_STRING)) {
+        if (RSTRING_LEN(v_values) % elementSize != 0) {
+            rb_raise(cError, "Packed %s size %ld is not a multiple of %zu", what, RSTRING_LEN(v_values), elementSize);
+        }
+        return RSTRING_LEN(v_values) / elementSize;
+    }
+
+    Check_Type(v_values, T_ARRAY);
+    return RARRAY_LEN(v_values);
+}
+
+static VALUE writeDataValues_body(struct RequestCall *call) {
+    VALUE v_nsIndex = call->argv[0];
+    VALUE v_names = call->argv[1];
+    VALUE v_type = call->argv[2];
+    VALUE v_values = call->argv[3];
+    VALUE v_timestamps = call->argv[4];
+    VALUE v_statuses = call->argv[5];
+
+    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    int nsIndex = FIX2INT(v_nsIndex);
+    int uaType = uaTypeFromSymbol(v_type);
+    const UA_DataType *type = &UA_TYPES[uaType];
+
+#if !(UA_BINARY_OVERLAYABLE_INTEGER && UA_BINARY_OVERLAYABLE_FLOAT)
+    if (RB_TYPE_P(v_values, T_STRING) || RB_TYPE_P(v_timestamps, T_STRING) || RB_TYPE_P(v_statuses, T_STRING)) {
+        rb_raise(cError, "Packed buffers require a little-endian host");
+    }
+#endif
+
+    if (RB_TYPE_P(v_values, T_STRING) && uaType == UA_TYPES_STRING) {
+        rb_raise(cError, "Packed buffers are not supported for string values");
+    }
+
+    const long count = packedOrArrayLength(v_values, type->memSize, "value");
+
+    /* A single name writes all points to the same node */
+    if (RB_TYPE_P(v_names, T_ARRAY)) {
+        if (RARRAY_LEN(v_names) != count) {
+            return raise_invalid_arguments_error();
+        }
+    } else if (RB_TYPE_P(v_names, T_STRING) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    if (!NIL_P(v_timestamps) && packedOrArrayLength(v_timestamps, sizeof(int64_t), "timestamp") != count) {
+        return raise_invalid_arguments_error();
+    }
+
+    if (!NIL_P(v_statuses) && packedOrArrayLength(v_statuses, sizeof(UA_StatusCode), "status") != count) {
+        return raise_invalid_arguments_error();
+    }
+
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    readOperationLimits(call->client, &ctx->operationLimits);
+
+    size_t chunk = chunkSize(ctx->operationLimits.maxNodesPerWrite, ctx->writeChunkSize);
+    if (chunk == 0 || chunk > (size_t)count) {
+        chunk = count;
+    }
+
+    UA_StatusCode *results = requestArena_alloc(&call->arena, count, sizeof(UA_StatusCode));
+    UA_WriteValue *wValues = requestArena_alloc(&call->arena, chunk, sizeof(UA_WriteValue));
+    char *scalars = requestArena_alloc(&call->arena, chunk, type->memSize);
+
+    for (long offset = 0; offset < count; offset += chunk) {
+        size_t n = count - offset < (long)chunk ? (size_t)(count - offset) : chunk;
+
+        for (size_t i = 0; i < n; i++) {
+            long point = offset + i;
+            UA_WriteValue *wValue = &wValues[i];
+            UA_WriteValue_init(wValue);
+            wValue->attributeId = UA_ATTRIBUTEID_VALUE;
+
+            VALUE v_name = RB_TYPE_P(v_names, T_ARRAY) ? rb_ary_entry(v_names, point) : v_names;
+            if (RB_TYPE_P(v_name, T_STRING) != 1) {
+                return raise_invalid_arguments_error();
+            }
+            wValue->nodeId = UA_NODEID_STRING(nsIndex, StringValueCStr(v_name));
+
+            /* Packed values are copied out, the String may not be aligned for them */
+            void *data = scalars + i * type->memSize;
+            if (RB_TYPE_P(v_values, T_STRING)) {
+                memcpy(data, RSTRING_PTR(v_values) + point * type->memSize, type->memSize);
+            } else {
+                rubyToUaScalar(rb_ary_entry(v_values, point), uaType, data);
+            }
+            UA_Variant_setScalar(&wValue->value.value, data, type);
+            wValue->value.value.storageType = UA_VARIANT_DATA_NODELETE;
+            wValue->value.hasValue = true;
+
+            if (RB_TYPE_P(v_timestamps, T_STRING)) {
+                int64_t nanos;
+                memcpy(&nanos, RSTRING_PTR(v_timestamps) + point * sizeof(int64_t), sizeof(int64_t));
+                wValue->value.sourceTimestamp = UA_DATETIME_UNIX_EPOCH + nanos / 100;
+                wValue->value.hasSourceTimestamp = true;
+            } else if (!NIL_P(v_timestamps)) {
+                wValue->value.sourceTimestamp = rubyToUaDateTime(rb_ary_entry(v_timestamps, point));
+                wValue->value.hasSourceTimestamp = true;
+            }
+
+            if (RB_TYPE_P(v_statuses, T_STRING)) {
+                memcpy(&wValue->value.status, RSTRING_PTR(v_statuses) + point * sizeof(UA_StatusCode), sizeof(UA_StatusCode));
+                wValue->value.hasStatus = true;
+            } else if (!NIL_P(v_statuses)) {
+                wValue->value.status = NUM2UINT(rb_ary_entry(v_statuses, point));
+                wValue->value.hasStatus = true;
+            }
+        }
+
+        UA_WriteRequest wReq;
+        UA_WriteRequest_init(&wReq);
+        wReq.nodesToWrite = wValues;
+        wReq.nodesToWriteSize = n;
+
+        UA_WriteResponse wResp = UA_Client_Service_write(call->client, wReq);
+        UA_StatusCode serviceResult = wResp.responseHeader.serviceResult;
+
+        for (size_t i = 0; i < n; i++) {
+            results[offset + i] = writeResultStatus(&wResp, n, i);
+        }
+        UA_WriteResponse_clear(&wResp);
+
+        if (serviceResult != UA_STATUSCODE_GOOD) {
+            /* The connection is gone or the request was refused, skip the rest */
+            for (long i = offset + n; i < count; i++) {
+                results[i] = serviceResult;
+            }
+            break;
+        }
+    }
+
+    RB_GC_GUARD(v_values);
+    RB_GC_GUARD(v_timestamps);
+    RB_GC_GUARD(v_statuses);
+
+    return rb_str_new((const char*)results, count * sizeof(UA_StatusCode));
+}
+
+static VALUE rb_writeDataValues(int argc, VALUE *argv, VALUE self) {
+    VALUE args[6];
+    rb_scan_args(argc, argv, "51", &args[0], &args[1], &args[2], &args[3], &args[4], &args[5]);
+    return withRequestArena(self, writeDataValues_body, args, 0);
+}
+
+static VALUE rb_getWriteChunkSize(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    return ULONG2NUM(ctx->writeChunkSize);
+}
+
+static VALUE rb_setWriteChunkSize(VALUE self, VALUE v_chunkSize) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    ctx->writeChunkSize = NUM2ULONG(v_chunkSize);
+    return v_chunkSize;
+}
+
+/* Publish pipeline
+ *
+ * open62541 keeps outstanding_publish_requests PublishRequests queued on the
+ * server (default 10), so notifications can be returned as soon as they are
+ * ready instead of waiting for the next request. queue_size is the default
+ * server side queue of new monitored items, holding the samples taken
+ * between two publishes. */
+
+static VALUE rb_getOutstandingPublishRequests(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    return UINT2NUM(UA_Client_getConfig(uclient->client)->outStandingPublishRequests);
+}
+
+static VALUE rb_setOutstandingPublishRequests(VALUE self, VALUE v_requests) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+
+    UA_UInt16 requests = NUM2USHORT(v_requests);
+    if (requests == 0) {
+        rb_raise(rb_eArgError, "at least one publish request must be outstanding");
+    }
+    UA_Client_getConfig(uclient->client)->outStandingPublishRequests = requests;
+    return v_requests;
+}
+
+static VALUE rb_getQueueSize(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    return UINT2NUM(ctx->queueSize);
+}
+
+static VALUE rb_setQueueSize(VALUE self, VALUE v_queueSize) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    ctx->queueSize = NUM2UINT(v_queueSize);
+    return v_queueSize;
+}
+
+/* Bulk monitored items
+ *
+ * add_monitored_items creates many data change items with one
+ * CreateMonitoredItems call per chunk instead of one round trip per node.
+ * Chunks follow the server's MaxMonitoredItemsPerCall limit. */
+
+#define MONITORED_ITEMS_CHUNK_SIZE 1000
+
+static VALUE addMonitoredItems_body(struct RequestCall *call) {
+    VALUE v_subscriptionId = call->argv[0];
+    VALUE v_nodes = call->argv[1];
+    VALUE v_options = call->argv[2];
+    VALUE v_handler = call->argv[3];
+
+    UA_UInt32 subscriptionId = NUM2UINT(v_subscriptionId);
+    Check_Type(v_nodes, T_ARRAY);
+    const long count = RARRAY_LEN(v_nodes);
+
+    /* Validate everything before items with contexts are handed to the client */
+    for (long i = 0; i < count; i++) {
+        VALUE v_node = rb_ary_entry(v_nodes, i);
+        if (!RB_TYPE_P(v_node, T_ARRAY) || RARRAY_LEN(v_node) < 2 || RARRAY_LEN(v_node) > 3 ||
+            !RB_TYPE_P(rb_ary_entry(v_node, 0), T_FIXNUM) || !RB_TYPE_P(rb_ary_entry(v_node, 1), T_STRING)) {
+            return raise_invalid_arguments_error();
+        }
+        StringValueCStr(RARRAY_PTR(v_node)[1]);
+    }
+
+    UA_MonitoredItemCreateRequest itemTemplate =
+        monitoredItemRequest_default(UA_Client_getContext(call->client), UA_NODEID_NULL);
+    UA_DataChangeFilter filter;
+    VALUE v_tag;
+    monitoredItemRequestFromOptions(&itemTemplate, v_options, &filter, &v_tag);
+
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    readOperationLimits(call->client, &ctx->operationLimits);
+
+    size_t chunk = chunkSize(ctx->operationLimits.maxMonitoredItemsPerCall, MONITORED_ITEMS_CHUNK_SIZE);
+    if (chunk > (size_t)count) {
+        chunk = count;
+    }
+
+    VALUE v_ids = rb_ary_new_capa(count);
+    VALUE v_statuses = rb_ary_new_capa(count);
+
+    if (count == 0) {
+        return rb_ary_new_from_args(2, v_ids, v_statuses);
+    }
+
+    struct SubscriptionRecord *record = subscriptionRecord_find(ctx, subscriptionId);
+
+    UA_MonitoredItemCreateRequest *items = requestArena_alloc(&call->arena, chunk, sizeof(UA_MonitoredItemCreateRequest));
+    VALUE *handlers = requestArena_alloc(&call->arena, chunk, sizeof(VALUE));
+    VALUE *tags = requestArena_alloc(&call->arena, chunk, sizeof(VALUE));
+    void **contexts = requestArena_alloc(&call->arena, chunk, sizeof(void*));
+    UA_Client_DataChangeNotificationCallback *callbacks = requestArena_alloc(&call->arena, chunk, sizeof(UA_Client_DataChangeNotificationCallback));
+    UA_Client_DeleteMonitoredItemCallback *deleteCallbacks = requestArena_alloc(&call->arena, chunk, sizeof(UA_Client_DeleteMonitoredItemCallback));
+
+    for (long offset = 0; offset < count; offset += chunk) {
+        size_t n = count - offset < (long)chunk ? (size_t)(count - offset) : chunk;
+        UA_StatusCode failure = UA_STATUSCODE_GOOD;
+
+        for (size_t i = 0; i < n; i++) {
+            VALUE v_node = rb_ary_entry(v_nodes, offset + i);
+            VALUE v_name = rb_ary_entry(v_node, 1);
+
+            items[i] = itemTemplate;
+            items[i].itemToMonitor.nodeId = UA_NODEID_STRING(FIX2INT(rb_ary_entry(v_node, 0)), StringValueCStr(v_name));
+            handlers[i] = v_handler;
+            tags[i] = RARRAY_LEN(v_node) == 3 ? rb_ary_entry(v_node, 2) : v_tag;
+            writeShadow_watch(&ctx->writeShadow, &items[i].itemToMonitor.nodeId);
+        }
+
+        size_t prepared = staleness_reserve(ctx, n) ?
+            dataChangeItems_prepare(ctx, items, handlers, tags, n, contexts, callbacks, deleteCallbacks) : 0;
+        if (prepared < n) {
+            failure = UA_STATUSCODE_BADOUTOFMEMORY;
+            n = prepared;
+        }
+
+        if (n == 0) {
+            for (long i = offset; i < count; i++) {
+                rb_ary_push(v_ids, Qnil);
+                rb_ary_push(v_statuses, UINT2NUM(failure));
+            }
+            break;
+        }
+
+        UA_CreateMonitoredItemsRequest request;
+        UA_CreateMonitoredItemsRequest_init(&request);
+        request.subscriptionId = subscriptionId;
+        request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+        request.itemsToCreate = items;
+        request.itemsToCreateSize = n;
+
+        UA_CreateMonitoredItemsResponse response =
+            UA_Client_MonitoredItems_createDataChanges(call->client, request, contexts, callbacks, deleteCallbacks);
+
+        for (size_t i = 0; i < n; i++) {
+            UA_StatusCode status = response.responseHeader.serviceResult;
+            UA_UInt32 monitoredItemId = 0;
+            if (status == UA_STATUSCODE_GOOD && i < response.resultsSize) {
+                status = response.results[i].statusCode;
+                monitoredItemId = response.results[i].monitoredItemId;
+            } else if (status == UA_STATUSCODE_GOOD) {
+                status = UA_STATUSCODE_BADUNEXPECTEDERROR;
+            }
+            rb_ary_push(v_ids, status == UA_STATUSCODE_GOOD ? UINT2NUM(monitoredItemId) : Qnil);
+            rb_ary_push(v_statuses, UINT2NUM(status));
+
+            if (status == UA_STATUSCODE_GOOD && items[i].monitoringMode == UA_MONITORINGMODE_REPORTING) {
+                staleness_track(ctx, contexts[i], subscriptionId, monitoredItemId, response.results[i].revisedSamplingInterval);
+            }
+
+            if (record && status == UA_STATUSCODE_GOOD) {
+                struct MonitoredItemContext *item = contexts[i];
+                subscriptionRecord_addItem(record, &items[i], monitoredItemId, item->handler, item->tag);
+            }
+        }
+
+        if (failure == UA_STATUSCODE_GOOD) {
+            failure = response.responseHeader.serviceResult;
+        }
+        UA_CreateMonitoredItemsResponse_clear(&response);
+
+        if (failure != UA_STATUSCODE_GOOD) {
+            /* Report the remaining nodes with the error and stop */
+            for (long i = RARRAY_LEN(v_ids); i < count; i++) {
+                rb_ary_push(v_ids, Qnil);
+                rb_ary_push(v_statuses, UINT2NUM(failure));
+            }
+            break;
+        }
+    }
+
+    RB_GC_GUARD(v_nodes);
+
+    return rb_ary_new_from_args(2, v_ids, v_statuses);
+}
+
+static VALUE rb_addMonitoredItems(int argc, VALUE *argv, VALUE self) {
+    VALUE args[4];
+    rb_scan_args(argc, argv, "21&", &args[0], &args[1], &args[2], &args[3]);
+    return withRequestArena(self, addMonitoredItems_body, args, 0);
+}
+
+/* Event monitored items
+ *
+ * add_event_monitored_item monitors the EventNotifier of an object (usually
+ * the Server object, ns 0 / 2253) with an EventFilter. Select clauses are
+ * BaseEventType browse paths such as "Severity" or "ActiveState/Id"; the
+ * where clause supports of_type: and min_severity:. The selected fields of
+ * each event are decoded natively into one Array. */
+
+static VALUE eventFieldToRuby(const UA_Variant *field, enum TimestampFormat format) {
+    if (!UA_Variant_isScalar(field) || !field->type) {
+        return Qnil;
+    }
+
+    switch (field->type->typeKind) {
+    case UA_DATATYPEKIND_BYTESTRING: {
+        UA_ByteString *bytes = (UA_ByteString*)field->data;
+        return rb_str_new((char*)bytes->data, bytes->length);
+    }
+    case UA_DATATYPEKIND_LOCALIZEDTEXT: {
+        UA_LocalizedText *text = (UA_LocalizedText*)field->data;
+        return rb_enc_str_new((char*)text->text.data, text->text.length, rb_utf8_encoding());
+    }
+    case UA_DATATYPEKIND_NODEID: return nodeIdIdentifierToRuby((UA_NodeId*)field->data);
+    default: return variantScalarToRuby(field, format);
+    }
+}
+
+static void handler_event(UA_Client *client, UA_UInt32 subId, void *subContext,
+        UA_UInt32 monId, void *monContext, size_t nEventFields, UA_Variant *eventFields) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    struct MonitoredItemContext *item = monContext;
+    enum TimestampFormat format = subContext ? *(const enum TimestampFormat*)subContext : ctx->timestampFormat;
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    health_activity(&ctx->health, now);
+
+    struct SubscriptionStats *stats = subscriptionStats_find(ctx, subId);
+    if (stats) {
+        stats->events++;
+        stats->lastNotification = now;
+    }
+
+    VALUE v_fields = rb_ary_new_capa(nEventFields);
+    for (size_t i = 0; i < nEventFields; i++) {
+        rb_ary_push(v_fields, eventFieldToRuby(&eventFields[i], format));
+    }
+
+    if (item && !NIL_P(item->handler)) {
+        VALUE params = rb_ary_new();
+        rb_ary_push(params, v_fields);
+        rb_ary_push(params, item->tag);
+        rb_proc_call(item->handler, params);
+        return;
+    }
+
+    VALUE callback = rb_ivar_get(ctx->rubyClientInstance, rb_intern("@callback_after_event"));
+    if (!NIL_P(callback)) {
+        VALUE params = rb_ary_new();
+        rb_ary_push(params, UINT2NUM(subId));
+        rb_ary_push(params, UINT2NUM(monId));
+        rb_ary_push(params, v_fields);
+        rb_proc_call(callback, params);
+    }
+}
+
+/* BaseEventType field operand for a browse path like "ActiveState/Id" */
+static void eventFieldOperand(struct RequestArena *arena, VALUE v_path, UA_SimpleAttributeOperand *operand) {
+    Check_Type(v_path, T_STRING);
+    const char *path = StringValueCStr(v_path);
+    size_t length = strlen(path);
+
+    /* Segments are split in an arena copy, QualifiedNames point into it */
+    char *copy = requestArena_alloc(arena, length + 1, 1);
+    memcpy(copy, path, length);
+
+    size_t segments = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (copy[i] == '/') {
+            segments++;
+        }
+    }
+
+    UA_SimpleAttributeOperand_init(operand);
+    operand->typeDefinitionId = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEEVENTTYPE);
+    operand->attributeId = UA_ATTRIBUTEID_VALUE;
+    operand->browsePath = requestArena_alloc(arena, segments, sizeof(UA_QualifiedName));
+    operand->browsePathSize = segments;
+
+    char *segment = copy;
+    for (size_t i = 0; i < segments; i++) {
+        char *end = strchr(segment, '/');
+        if (end) {
+            *end = '\0';
+        }
+        operand->browsePath[i] = UA_QUALIFIEDNAME(0, segment);
+        segment = end ? end + 1 : segment;
+    }
+}
+
+static void literalOperand(struct RequestArena *arena, UA_ContentFilterElement *element, size_t index,
+        void *value, const UA_DataType *type) {
+    UA_LiteralOperand *literal = requestArena_alloc(arena, 1, sizeof(UA_LiteralOperand));
+    UA_Variant_setScalar(&literal->value, value, type);
+    literal->value.storageType = UA_VARIANT_DATA_NODELETE;
+    UA_ExtensionObject_setValueNoDelete(&element->filterOperands[index], literal, &UA_TYPES[UA_TYPES_LITERALOPERAND]);
+}
+
+static void elementOperand(struct RequestArena *arena, UA_ContentFilterElement *element, size_t index, UA_UInt32 target) {
+    UA_ElementOperand *operand = requestArena_alloc(arena, 1, sizeof(UA_ElementOperand));
+    operand->index = target;
+    UA_ExtensionObject_setValueNoDelete(&element->filterOperands[index], operand, &UA_TYPES[UA_TYPES_ELEMENTOPERAND]);
+}
+
+/* where: { of_type: Fixnum (ns 0 event type), min_severity: Fixnum } */
+static void eventWhereClause(struct RequestArena *arena, VALUE v_where, UA_ContentFilter *where) {
+    UA_ContentFilter_init(where);
+    if (NIL_P(v_where)) {
+        return;
+    }
+
+    static const char *const names[2] = { "of_type", "min_severity" };
+    VALUE values[2];
+    keywordsFromRuby(v_where, names, 2, values);
+
+    UA_Boolean ofType = values[0] != Qundef;
+    UA_Boolean minSeverity = values[1] != Qundef;
+    if (!ofType && !minSeverity) {
+        return;
+    }
+
+    /* With both conditions, element 0 ANDs elements 1 and 2 */
+    size_t count = ofType && minSeverity ? 3 : 1;
+    size_t next = count == 3 ? 1 : 0;
+    where->elements = requestArena_alloc(arena, count, sizeof(UA_ContentFilterElement));
+    where->elementsSize = count;
+
+    if (count == 3) {
+        UA_ContentFilterElement *and = &where->elements[0];
+        and->filterOperator = UA_FILTEROPERATOR_AND;
+        and->filterOperands = requestArena_alloc(arena, 2, sizeof(UA_ExtensionObject));
+        and->filterOperandsSize = 2;
+        elementOperand(arena, and, 0, 1);
+        elementOperand(arena, and, 1, 2);
+    }
+
+    if (ofType) {
+        UA_ContentFilterElement *element = &where->elements[next++];
+        UA_NodeId *typeId = requestArena_alloc(arena, 1, sizeof(UA_NodeId));
+        *typeId = UA_NODEID_NUMERIC(0, NUM2UINT(values[0]));
+
+        element->filterOperator = UA_FILTEROPERATOR_OFTYPE;
+        element->filterOperands = requestArena_alloc(arena, 1, sizeof(UA_ExtensionObject));
+        element->filterOperandsSize = 1;
+        literalOperand(arena, element, 0, typeId, &UA_TYPES[UA_TYPES_NODEID]);
+    }
+
+    if (minSeverity) {
+        UA_ContentFilterElement *element = &where->elements[next++];
+        UA_SimpleAttributeOperand *severity = requestArena_alloc(arena, 1, sizeof(UA_SimpleAttributeOperand));
+        eventFieldOperand(arena, rb_str_new_cstr("Severity"), severity);
+        UA_UInt16 *threshold = requestArena_alloc(arena, 1, sizeof(UA_UInt16));
+        *threshold = NUM2USHORT(values[1]);
+
+        element->filterOperator = UA_FILTEROPERATOR_GREATERTHANOREQUAL;
+        element->filterOperands = requestArena_alloc(arena, 2, sizeof(UA_ExtensionObject));
+        element->filterOperandsSize = 2;
+        UA_ExtensionObject_setValueNoDelete(&element->filterOperands[0], severity, &UA_TYPES[UA_TYPES_SIMPLEATTRIBUTEOPERAND]);
+        literalOperand(arena, element, 1, threshold, &UA_TYPES[UA_TYPES_UINT16]);
+    }
+}
+
+static VALUE addEventMonitoredItem_body(struct RequestCall *call) {
+    UA_UInt32 subscriptionId = NUM2UINT(call->argv[0]);
+    VALUE v_nsIndex = call->argv[1];
+    VALUE v_name = call->argv[2];
+    VALUE v_options = call->argv[3];
+    VALUE v_handler = call->argv[4];
+
+    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    /* Numeric identifiers address standard objects like the Server object */
+    UA_NodeId nodeId;
+    if (RB_INTEGER_TYPE_P(v_name)) {
+        nodeId = UA_NODEID_NUMERIC(FIX2INT(v_nsIndex), NUM2UINT(v_name));
+    } else if (RB_TYPE_P(v_name, T_STRING)) {
+        nodeId = UA_NODEID_STRING(FIX2INT(v_nsIndex), StringValueCStr(v_name));
+    } else {
+        return raise_invalid_arguments_error();
+    }
+
+    static const char *const names[3] = { "select", "where", "queue_size" };
+    VALUE values[3];
+    keywordsFromRuby(v_options, names, 3, values);
+    if (values[0] == Qundef) {
+        rb_raise(rb_eArgError, "missing keyword: :select");
+    }
+
+    VALUE v_select = values[0];
+    Check_Type(v_select, T_ARRAY);
+
+    UA_EventFilter *filter = requestArena_alloc(&call->arena, 1, sizeof(UA_EventFilter));
+    filter->selectClausesSize = RARRAY_LEN(v_select);
+    filter->selectClauses = requestArena_alloc(&call->arena, filter->selectClausesSize, sizeof(UA_SimpleAttributeOperand));
+    for (size_t i = 0; i < filter->selectClausesSize; i++) {
+        eventFieldOperand(&call->arena, rb_ary_entry(v_select, i), &filter->selectClauses[i]);
+    }
+    eventWhereClause(&call->arena, values[1] == Qundef ? Qnil : values[1], &filter->whereClause);
+
+    UA_MonitoredItemCreateRequest request = UA_MonitoredItemCreateRequest_default(nodeId);
+    request.itemToMonitor.attributeId = UA_ATTRIBUTEID_EVENTNOTIFIER;
+    request.requestedParameters.samplingInterval = 0;
+    request.requestedParameters.queueSize = values[2] == Qundef ? 100 : NUM2UINT(values[2]);
+    UA_ExtensionObject_setValueNoDelete(&request.requestedParameters.filter, filter, &UA_TYPES[UA_TYPES_EVENTFILTER]);
+
+    struct MonitoredItemContext *item =
+        monitoredItemContext_new(UA_Client_getContext(call->client), &nodeId, v_handler, Qnil);
+    if (!item) {
+        return raise_ua_status_error(UA_STATUSCODE_BADOUTOFMEMORY);
+    }
+
+    UA_MonitoredItemCreateResult result =
+        UA_Client_MonitoredItems_createEvent(call->client, subscriptionId, UA_TIMESTAMPSTORETURN_BOTH,
+                                             request, item, handler_event, monitoredItemDeleted);
+
+    UA_StatusCode status = result.statusCode;
+    UA_UInt32 monitoredItemId = result.monitoredItemId;
+    UA_MonitoredItemCreateResult_clear(&result);
+
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+
+    /* The record copies the filter out of the arena */
+    struct SubscriptionRecord *record = subscriptionRecord_find(UA_Client_getContext(call->client), subscriptionId);
+    if (record) {
+        subscriptionRecord_addItem(record, &request, monitoredItemId, v_handler, Qnil);
+    }
+
+    return UINT2NUM(monitoredItemId);
+}
+
+static VALUE rb_addEventMonitoredItem(int argc, VALUE *argv, VALUE self) {
+    VALUE args[5];
+    rb_scan_args(argc, argv, "3:&", &args[0], &args[1], &args[2], &args[3], &args[4]);
+    return withRequestArena(self, addEventMonitoredItem_body, args, 0);
+}
+
+/* Bulk changes to monitored items and subscriptions
+ *
+ * modify_monitored_items, delete_monitored_items, set_monitoring_mode and
+ * delete_subscriptions take arrays of ids and return a status per id. Item
+ * calls are chunked like add_monitored_items. Recorded subscriptions (see
+ * preserve_subscriptions) are kept in step so recovery recreates the items
+ * as they are now. */
+
+typedef UA_StatusCode (*ItemService)(UA_Client *client, UA_UInt32 subscriptionId, UA_UInt32 *ids, size_t count,
+        UA_StatusCode *results, const void *data);
+
+static void runItemService(UA_Client *client, size_t chunk, UA_UInt32 subscriptionId, UA_UInt32 *ids, size_t count,
+        UA_StatusCode *results, ItemService service, const void *data) {
+    for (size_t offset = 0; offset < count; offset += chunk) {
+        size_t n = count - offset < chunk ? count - offset : chunk;
+        UA_StatusCode serviceResult = service(client, subscriptionId, ids + offset, n, results + offset, data);
+
+        if (serviceResult != UA_STATUSCODE_GOOD) {
+            for (size_t i = offset; i < count; i++) {
+                results[i] = serviceResult;
             }
-            UA_Boolean newValue = RTEST(v_newValue);
-            values[i].data = UA_malloc(sizeof(UA_Boolean));
-            *(UA_Boolean*)values[i].data = newValue;
-            values[i].type = &UA_TYPES[UA_TYPES_BOOLEAN];
+            break;
+        }
+    }
+}
+
+/* Per item results, or the service result for all of them */
+static UA_StatusCode itemResults(const UA_ResponseHeader *header, const UA_StatusCode *responseResults, size_t resultsSize,
+        size_t count, UA_StatusCode *results) {
+    for (size_t i = 0; i < count; i++) {
+        if (header->serviceResult != UA_STATUSCODE_GOOD) {
+            results[i] = header->serviceResult;
         } else {
-            rb_raise(cError, "Unsupported type");
+            results[i] = i < resultsSize ? responseResults[i] : UA_STATUSCODE_BADUNEXPECTEDERROR;
+        }
+    }
+    return header->serviceResult;
+}
+
+static UA_StatusCode deleteItemsService(UA_Client *client, UA_UInt32 subscriptionId, UA_UInt32 *ids, size_t count,
+        UA_StatusCode *results, const void *data) {
+    UA_DeleteMonitoredItemsRequest request;
+    UA_DeleteMonitoredItemsRequest_init(&request);
+    request.subscriptionId = subscriptionId;
+    request.monitoredItemIds = ids;
+    request.monitoredItemIdsSize = count;
+
+    UA_DeleteMonitoredItemsResponse response = UA_Client_MonitoredItems_delete(client, request);
+    UA_StatusCode status = itemResults(&response.responseHeader, response.results, response.resultsSize, count, results);
+    UA_DeleteMonitoredItemsResponse_clear(&response);
+    return status;
+}
+
+static UA_StatusCode setMonitoringModeService(UA_Client *client, UA_UInt32 subscriptionId, UA_UInt32 *ids, size_t count,
+        UA_StatusCode *results, const void *data) {
+    UA_SetMonitoringModeRequest request;
+    UA_SetMonitoringModeRequest_init(&request);
+    request.subscriptionId = subscriptionId;
+    request.monitoringMode = *(const UA_MonitoringMode*)data;
+    request.monitoredItemIds = ids;
+    request.monitoredItemIdsSize = count;
+
+    UA_SetMonitoringModeResponse response = UA_Client_MonitoredItems_setMonitoringMode(client, request);
+    UA_StatusCode status = itemResults(&response.responseHeader, response.results, response.resultsSize, count, results);
+    UA_SetMonitoringModeResponse_clear(&response);
+    return status;
+}
+
+/* Options of modify_monitored_items, applied over the parameters each
+ * recorded item has; items that are not recorded start from the defaults */
+struct ModifyItems {
+    UA_MonitoringParameters parameters;
+    unsigned given;
+    const struct SubscriptionRecord *record;
+};
+
+static const UA_MonitoredItemCreateRequest *subscriptionRecord_item(const struct SubscriptionRecord *record,
+        UA_UInt32 monitoredItemId) {
+    for (size_t i = 0; record && i < record->itemCount; i++) {
+        if (record->itemIds[i] == monitoredItemId) {
+            return &record->items[i];
+        }
+    }
+    return NULL;
+}
+
+/* The given parameters over base; the filter is shared, not copied */
+static UA_MonitoringParameters modifyItems_apply(const struct ModifyItems *modify, const UA_MonitoringParameters *base) {
+    UA_MonitoringParameters parameters = *base;
+    if (modify->given & PARAMETER_SAMPLING_INTERVAL) parameters.samplingInterval = modify->parameters.samplingInterval;
+    if (modify->given & PARAMETER_QUEUE_SIZE) parameters.queueSize = modify->parameters.queueSize;
+    if (modify->given & PARAMETER_DISCARD_OLDEST) parameters.discardOldest = modify->parameters.discardOldest;
+    if (modify->given & PARAMETER_FILTER) parameters.filter = modify->parameters.filter;
+    return parameters;
+}
+
+static UA_StatusCode modifyItemsService(UA_Client *client, UA_UInt32 subscriptionId, UA_UInt32 *ids, size_t count,
+        UA_StatusCode *results, const void *data) {
+    const struct ModifyItems *modify = data;
+    UA_MonitoredItemModifyRequest *items = UA_calloc(count, sizeof(UA_MonitoredItemModifyRequest));
+    if (!items) {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    /* The parameters, filter included, are shared and not owned */
+    for (size_t i = 0; i < count; i++) {
+        const UA_MonitoredItemCreateRequest *recorded = subscriptionRecord_item(modify->record, ids[i]);
+        items[i].monitoredItemId = ids[i];
+        items[i].requestedParameters =
+            modifyItems_apply(modify, recorded ? &recorded->requestedParameters : &modify->parameters);
+    }
+
+    UA_ModifyMonitoredItemsRequest request;
+    UA_ModifyMonitoredItemsRequest_init(&request);
+    request.subscriptionId = subscriptionId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+    request.itemsToModify = items;
+    request.itemsToModifySize = count;
+
+    UA_ModifyMonitoredItemsResponse response = UA_Client_MonitoredItems_modify(client, request);
+    UA_free(items);
+
+    for (size_t i = 0; i < count; i++) {
+        results[i] = response.responseHeader.serviceResult;
+        if (results[i] == UA_STATUSCODE_GOOD) {
+            results[i] = i < response.resultsSize ? response.results[i].statusCode : UA_STATUSCODE_BADUNEXPECTEDERROR;
+        }
+        if (results[i] == UA_STATUSCODE_GOOD) {
+            staleness_revise(UA_Client_getContext(client), subscriptionId, ids[i], response.results[i].revisedSamplingInterval);
+        }
+    }
+
+    UA_StatusCode status = response.responseHeader.serviceResult;
+    UA_ModifyMonitoredItemsResponse_clear(&response);
+    return status;
+}
+
+static UA_StatusCode deleteSubscriptionsService(UA_Client *client, UA_UInt32 subscriptionId, UA_UInt32 *ids, size_t count,
+        UA_StatusCode *results, const void *data) {
+    UA_DeleteSubscriptionsRequest request;
+    UA_DeleteSubscriptionsRequest_init(&request);
+    request.subscriptionIds = ids;
+    request.subscriptionIdsSize = count;
+
+    UA_DeleteSubscriptionsResponse response = UA_Client_Subscriptions_delete(client, request);
+    UA_StatusCode status = itemResults(&response.responseHeader, response.results, response.resultsSize, count, results);
+    UA_DeleteSubscriptionsResponse_clear(&response);
+    return status;
+}
+
+static int compareUInt32(const void *a, const void *b) {
+    UA_UInt32 x = *(const UA_UInt32*)a;
+    UA_UInt32 y = *(const UA_UInt32*)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts the ids that succeeded into good, returns their count */
+static size_t succeededIds(const UA_UInt32 *ids, const UA_StatusCode *results, size_t count, UA_UInt32 *good) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] == UA_STATUSCODE_GOOD) {
+            good[n++] = ids[i];
+        }
+    }
+    qsort(good, n, sizeof(UA_UInt32), compareUInt32);
+    return n;
+}
+
+enum RecordUpdate {
+    RECORD_DELETE_ITEMS,
+    RECORD_MODIFY_ITEMS,
+    RECORD_SET_MONITORING_MODE
+};
+
+static void subscriptionRecord_update(struct SubscriptionRecord *record, const UA_UInt32 *good, size_t goodCount,
+        enum RecordUpdate update, const void *data) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < record->itemCount; i++) {
+        UA_Boolean matched = bsearch(&record->itemIds[i], good, goodCount, sizeof(UA_UInt32), compareUInt32) != NULL;
+
+        if (matched && update == RECORD_DELETE_ITEMS) {
+            UA_MonitoredItemCreateRequest_clear(&record->items[i]);
+            continue;
+        }
+
+        if (matched && update == RECORD_MODIFY_ITEMS) {
+            UA_MonitoringParameters parameters;
+            UA_MonitoringParameters modified = modifyItems_apply(data, &record->items[i].requestedParameters);
+            if (UA_MonitoringParameters_copy(&modified, &parameters) == UA_STATUSCODE_GOOD) {
+                UA_MonitoringParameters_clear(&record->items[i].requestedParameters);
+                record->items[i].requestedParameters = parameters;
+            }
+        } else if (matched && update == RECORD_SET_MONITORING_MODE) {
+            record->items[i].monitoringMode = *(const UA_MonitoringMode*)data;
+        }
+
+        record->items[kept] = record->items[i];
+        record->itemIds[kept] = record->itemIds[i];
+        record->handlers[kept] = record->handlers[i];
+        record->tags[kept] = record->tags[i];
+        kept++;
+    }
+
+    record->itemCount = kept;
+
+    if (update != RECORD_DELETE_ITEMS) {
+        return;
+    }
+
+    kept = 0;
+    for (size_t i = 0; i < record->linkCount; i++) {
+        struct TriggerLink link = record->links[i];
+        if (bsearch(&link.triggeringId, good, goodCount, sizeof(UA_UInt32), compareUInt32) ||
+            bsearch(&link.triggeredId, good, goodCount, sizeof(UA_UInt32), compareUInt32)) {
+            continue;
+        }
+        record->links[kept++] = link;
+    }
+    record->linkCount = kept;
+}
+
+static UA_UInt32 *idsFromRuby(struct RequestArena *arena, VALUE v_ids, size_t *count) {
+    Check_Type(v_ids, T_ARRAY);
+    *count = RARRAY_LEN(v_ids);
+
+    UA_UInt32 *ids = requestArena_alloc(arena, *count, sizeof(UA_UInt32));
+    for (size_t i = 0; i < *count; i++) {
+        ids[i] = NUM2UINT(rb_ary_entry(v_ids, i));
+    }
+    return ids;
+}
+
+static VALUE statusesToRuby(const UA_StatusCode *results, size_t count) {
+    VALUE v_statuses = rb_ary_new_capa(count);
+    for (size_t i = 0; i < count; i++) {
+        rb_ary_push(v_statuses, UINT2NUM(results[i]));
+    }
+    return v_statuses;
+}
+
+/* Shared by the item calls: argv is subscription id, item ids, service data */
+static VALUE itemService_body(struct RequestCall *call, ItemService service, enum RecordUpdate update, const void *data) {
+    UA_UInt32 subscriptionId = NUM2UINT(call->argv[0]);
+
+    size_t count;
+    UA_UInt32 *ids = idsFromRuby(&call->arena, call->argv[1], &count);
+    UA_StatusCode *results = requestArena_alloc(&call->arena, count, sizeof(UA_StatusCode));
+
+    if (count == 0) {
+        return rb_ary_new();
+    }
+
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    readOperationLimits(call->client, &ctx->operationLimits);
+    size_t chunk = chunkSize(ctx->operationLimits.maxMonitoredItemsPerCall, MONITORED_ITEMS_CHUNK_SIZE);
+
+    runItemService(call->client, chunk, subscriptionId, ids, count, results, service, data);
+
+    struct SubscriptionRecord *record = subscriptionRecord_find(ctx, subscriptionId);
+    if (record) {
+        UA_UInt32 *good = requestArena_alloc(&call->arena, count, sizeof(UA_UInt32));
+        size_t goodCount = succeededIds(ids, results, count, good);
+        subscriptionRecord_update(record, good, goodCount, update, data);
+    }
+
+    return statusesToRuby(results, count);
+}
+
+static VALUE deleteMonitoredItems_body(struct RequestCall *call) {
+    return itemService_body(call, deleteItemsService, RECORD_DELETE_ITEMS, NULL);
+}
+
+static VALUE rb_deleteMonitoredItems(VALUE self, VALUE v_subscriptionId, VALUE v_ids) {
+    const VALUE argv[] = { v_subscriptionId, v_ids };
+    return withRequestArena(self, deleteMonitoredItems_body, argv, 0);
+}
+
+static VALUE setMonitoringMode_body(struct RequestCall *call) {
+    UA_MonitoringMode mode = monitoringModeFromSymbol(call->argv[2]);
+    return itemService_body(call, setMonitoringModeService, RECORD_SET_MONITORING_MODE, &mode);
+}
+
+static VALUE rb_setMonitoringMode(VALUE self, VALUE v_subscriptionId, VALUE v_ids, VALUE v_mode) {
+    const VALUE argv[] = { v_subscriptionId, v_ids, v_mode };
+    return withRequestArena(self, setMonitoringMode_body, argv, 0);
+}
+
+static VALUE modifyMonitoredItems_body(struct RequestCall *call) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    UA_MonitoredItemCreateRequest itemTemplate = monitoredItemRequest_default(ctx, UA_NODEID_NULL);
+    UA_DataChangeFilter filter;
+    VALUE v_tag;
+    unsigned given = monitoredItemRequestFromOptions(&itemTemplate, call->argv[2], &filter, &v_tag);
+
+    if (itemTemplate.monitoringMode != UA_MONITORINGMODE_REPORTING || !NIL_P(v_tag)) {
+        rb_raise(rb_eArgError, "use set_monitoring_mode to change the mode, tags cannot be modified");
+    }
+
+    struct ModifyItems modify = { itemTemplate.requestedParameters, given,
+                                  subscriptionRecord_find(ctx, NUM2UINT(call->argv[0])) };
+
+    /* Only recorded items have parameters to keep */
+    if ((given & PARAMETERS_COMPLETE) != PARAMETERS_COMPLETE) {
+        Check_Type(call->argv[1], T_ARRAY);
+        for (long i = 0; i < RARRAY_LEN(call->argv[1]); i++) {
+            if (!subscriptionRecord_item(modify.record, NUM2UINT(rb_ary_entry(call->argv[1], i)))) {
+                rb_raise(rb_eArgError, "sampling_interval, queue_size and discard_oldest are required "
+                                       "unless the items are recorded by preserve_subscriptions");
+            }
+        }
+    }
+
+    return itemService_body(call, modifyItemsService, RECORD_MODIFY_ITEMS, &modify);
+}
+
+static VALUE rb_modifyMonitoredItems(VALUE self, VALUE v_subscriptionId, VALUE v_ids, VALUE v_options) {
+    const VALUE argv[] = { v_subscriptionId, v_ids, v_options };
+    return withRequestArena(self, modifyMonitoredItems_body, argv, 0);
+}
+
+static VALUE deleteSubscriptions_body(struct RequestCall *call) {
+    size_t count;
+    UA_UInt32 *ids = idsFromRuby(&call->arena, call->argv[0], &count);
+    UA_StatusCode *results = requestArena_alloc(&call->arena, count, sizeof(UA_StatusCode));
+
+    if (count == 0) {
+        return rb_ary_new();
+    }
+
+    /* Forget the records first, so the delete callback does not schedule a recovery */
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    for (size_t i = 0; i < count; i++) {
+        struct SubscriptionRecord **link = &ctx->subscriptionRecords;
+        while (*link) {
+            struct SubscriptionRecord *record = *link;
+            if (record->subscriptionId == ids[i]) {
+                *link = record->next;
+                subscriptionRecord_free(record);
+            } else {
+                link = &record->next;
+            }
+        }
+    }
+
+    runItemService(call->client, count, 0, ids, count, results, deleteSubscriptionsService, NULL);
+    return statusesToRuby(results, count);
+}
+
+static VALUE rb_deleteSubscriptions(VALUE self, VALUE v_ids) {
+    const VALUE argv[] = { v_ids };
+    return withRequestArena(self, deleteSubscriptions_body, argv, 0);
+}
+
+/* Triggering links
+ *
+ * Items linked to a triggering item report their samples only when the
+ * triggering item reports, which makes sense for items created with
+ * monitoring_mode: :sampling. Links of recorded subscriptions are restored
+ * by recovery. */
+
+static void setTriggering(UA_Client *client, UA_UInt32 subscriptionId, UA_UInt32 triggeringId,
+        UA_UInt32 *add, size_t addCount, UA_StatusCode *addResults,
+        UA_UInt32 *remove, size_t removeCount, UA_StatusCode *removeResults) {
+    UA_SetTriggeringRequest request;
+    UA_SetTriggeringRequest_init(&request);
+    request.subscriptionId = subscriptionId;
+    request.triggeringItemId = triggeringId;
+    request.linksToAdd = add;
+    request.linksToAddSize = addCount;
+    request.linksToRemove = remove;
+    request.linksToRemoveSize = removeCount;
+
+    UA_SetTriggeringResponse response = UA_Client_MonitoredItems_setTriggering(client, request);
+    itemResults(&response.responseHeader, response.addResults, response.addResultsSize, addCount, addResults);
+    itemResults(&response.responseHeader, response.removeResults, response.removeResultsSize, removeCount, removeResults);
+    UA_SetTriggeringResponse_clear(&response);
+}
+
+static VALUE setTriggering_body(struct RequestCall *call) {
+    UA_UInt32 subscriptionId = NUM2UINT(call->argv[0]);
+    UA_UInt32 triggeringId = NUM2UINT(call->argv[1]);
+
+    size_t addCount, removeCount = 0;
+    UA_UInt32 *add = idsFromRuby(&call->arena, call->argv[2], &addCount);
+    UA_UInt32 *remove = NIL_P(call->argv[3]) ? NULL : idsFromRuby(&call->arena, call->argv[3], &removeCount);
+    UA_StatusCode *addResults = requestArena_alloc(&call->arena, addCount, sizeof(UA_StatusCode));
+    UA_StatusCode *removeResults = requestArena_alloc(&call->arena, removeCount, sizeof(UA_StatusCode));
+
+    if (addCount > 0 || removeCount > 0) {
+        setTriggering(call->client, subscriptionId, triggeringId, add, addCount, addResults, remove, removeCount,
+                      removeResults);
+    }
+
+    struct SubscriptionRecord *record = subscriptionRecord_find(UA_Client_getContext(call->client), subscriptionId);
+    if (record) {
+        for (size_t i = 0; i < removeCount; i++) {
+            if (removeResults[i] == UA_STATUSCODE_GOOD) {
+                subscriptionRecord_setLink(record, triggeringId, remove[i], false);
+            }
+        }
+        for (size_t i = 0; i < addCount; i++) {
+            if (addResults[i] == UA_STATUSCODE_GOOD) {
+                subscriptionRecord_setLink(record, triggeringId, add[i], true);
+            }
+        }
+    }
+
+    VALUE v_result = rb_ary_new_capa(2);
+    rb_ary_push(v_result, statusesToRuby(addResults, addCount));
+    rb_ary_push(v_result, statusesToRuby(removeResults, removeCount));
+    return v_result;
+}
+
+static VALUE rb_setTriggering(int argc, VALUE *argv, VALUE self) {
+    VALUE args[4];
+    rb_scan_args(argc, argv, "31", &args[0], &args[1], &args[2], &args[3]);
+    return withRequestArena(self, setTriggering_body, args, 0);
+}
+
+/* Relinks the recreated items of a recovered record. previousIds holds the
+ * item ids of the lost subscription, in record order. */
+static void restoreTriggering(UA_Client *client, struct SubscriptionRecord *record, const UA_UInt32 *previousIds) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < record->linkCount; i++) {
+        struct TriggerLink link = { 0, 0 };
+        for (size_t j = 0; j < record->itemCount; j++) {
+            if (previousIds[j] == record->links[i].triggeringId) link.triggeringId = record->itemIds[j];
+            if (previousIds[j] == record->links[i].triggeredId) link.triggeredId = record->itemIds[j];
+        }
+
+        /* Items that could not be recreated lose their links */
+        if (link.triggeringId && link.triggeredId) {
+            record->links[kept++] = link;
+        }
+    }
+    record->linkCount = kept;
+
+    for (size_t i = 0; i < record->linkCount;) {
+        /* Links are added per triggering item, so they come in runs */
+        size_t run = 1;
+        while (i + run < record->linkCount && record->links[i + run].triggeringId == record->links[i].triggeringId) {
+            run++;
+        }
+
+        UA_UInt32 *triggered = UA_malloc(run * sizeof(UA_UInt32));
+        UA_StatusCode *results = UA_malloc(run * sizeof(UA_StatusCode));
+        if (triggered && results) {
+            for (size_t j = 0; j < run; j++) {
+                triggered[j] = record->links[i + j].triggeredId;
+            }
+            setTriggering(client, record->subscriptionId, record->links[i].triggeringId, triggered, run, results,
+                          NULL, 0, NULL);
+        }
+        UA_free(triggered);
+        UA_free(results);
+        i += run;
+    }
+}
+
+static UA_Boolean isEventItem(const UA_MonitoredItemCreateRequest *item) {
+    return item->itemToMonitor.attributeId == UA_ATTRIBUTEID_EVENTNOTIFIER;
+}
+
+/* Recreates the recorded items of a recovered subscription, a chunk per
+ * CreateMonitoredItems call, event items in calls of their own. Fills in
+ * the new item ids, the status of each item and its new context. */
+static void recoverItems(UA_Client *client, struct RequestArena *arena, struct SubscriptionRecord *record, size_t chunk,
+        UA_StatusCode *statuses, void **itemContexts) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+
+    for (size_t i = 0; i < record->itemCount; i++) {
+        statuses[i] = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    size_t n = chunk < record->itemCount ? chunk : record->itemCount;
+    UA_Client_DataChangeNotificationCallback *callbacks = requestArena_alloc(arena, n, sizeof(UA_Client_DataChangeNotificationCallback));
+    UA_Client_DeleteMonitoredItemCallback *deleteCallbacks = requestArena_alloc(arena, n, sizeof(UA_Client_DeleteMonitoredItemCallback));
+    UA_Client_EventNotificationCallback *eventCallbacks = requestArena_alloc(arena, n, sizeof(UA_Client_EventNotificationCallback));
+
+    for (size_t offset = 0; offset < record->itemCount;) {
+        size_t count = record->itemCount - offset < n ? record->itemCount - offset : n;
+        void **contexts = &itemContexts[offset];
+
+        UA_Boolean events = isEventItem(&record->items[offset]);
+        for (size_t i = 1; i < count; i++) {
+            if (isEventItem(&record->items[offset + i]) != events) {
+                count = i;
+                break;
+            }
+        }
+
+        /* Items left out for lack of memory go into the next call */
+        if (!staleness_reserve(ctx, count)) {
+            break;
+        }
+        count = dataChangeItems_prepare(ctx, &record->items[offset], &record->handlers[offset], &record->tags[offset],
+                                        count, contexts, callbacks, deleteCallbacks);
+        if (count == 0) {
+            break;
+        }
+        for (size_t i = 0; events && i < count; i++) {
+            eventCallbacks[i] = handler_event;
         }
+
+        UA_CreateMonitoredItemsRequest request;
+        UA_CreateMonitoredItemsRequest_init(&request);
+        request.subscriptionId = record->subscriptionId;
+        request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+        request.itemsToCreate = &record->items[offset];
+        request.itemsToCreateSize = count;
+
+        UA_CreateMonitoredItemsResponse response = events ?
+            UA_Client_MonitoredItems_createEvents(client, request, contexts, eventCallbacks, deleteCallbacks) :
+            UA_Client_MonitoredItems_createDataChanges(client, request, contexts, callbacks, deleteCallbacks);
+
+        for (size_t i = 0; i < count; i++) {
+            UA_StatusCode status = response.responseHeader.serviceResult;
+            if (status == UA_STATUSCODE_GOOD) {
+                status = i < response.resultsSize ? response.results[i].statusCode : UA_STATUSCODE_BADUNEXPECTEDERROR;
+            }
+            statuses[offset + i] = status;
+            if (status != UA_STATUSCODE_GOOD) {
+                /* Already freed by monitoredItemDeleted */
+                contexts[i] = NULL;
+                continue;
+            }
+
+            record->itemIds[offset + i] = response.results[i].monitoredItemId;
+            if (!events && record->items[offset + i].monitoringMode == UA_MONITORINGMODE_REPORTING) {
+                staleness_track(ctx, contexts[i], record->subscriptionId, record->itemIds[offset + i],
+                                response.results[i].revisedSamplingInterval);
+            }
+        }
+        UA_CreateMonitoredItemsResponse_clear(&response);
+        offset += count;
+    }
+}
+
+/* Recreates one lost subscription, argv[0] being its previous id. Buffers
+ * live in the request arena and the Ruby arrays are allocated before the
+ * record changes, so raising leaves neither leaks nor a half recovered
+ * record. Returns the after_subscription_recovered arguments, nil if the
+ * subscription could not be created. */
+static VALUE recoverSubscription_body(struct RequestCall *call) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(call->client);
+    UA_UInt32 previousId = NUM2UINT(call->argv[0]);
+
+    struct SubscriptionRecord *record = ctx->subscriptionRecords;
+    while (record && !(record->lost && record->subscriptionId == previousId)) {
+        record = record->next;
+    }
+    if (!record) {
+        return Qnil;
+    }
+
+    size_t itemCount = record->itemCount;
+    size_t chunk = chunkSize(ctx->operationLimits.maxMonitoredItemsPerCall, MONITORED_ITEMS_CHUNK_SIZE);
+    UA_UInt32 *previousIds = requestArena_alloc(&call->arena, itemCount, sizeof(UA_UInt32));
+    UA_StatusCode *statuses = requestArena_alloc(&call->arena, itemCount, sizeof(UA_StatusCode));
+    void **itemContexts = requestArena_alloc(&call->arena, itemCount, sizeof(void*));
+    VALUE v_previousItemIds = rb_ary_new_capa(itemCount);
+    VALUE v_itemIds = rb_ary_new_capa(itemCount);
+    VALUE v_statuses = rb_ary_new_capa(itemCount);
+    VALUE v_recovered = rb_ary_new_capa(5);
+
+    UA_CreateSubscriptionResponse response =
+        UA_Client_Subscriptions_create(call->client, record->request, record->context, subscriptionStatusChanged,
+                                       deleteSubscriptionCallback);
+    if (response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+        return Qnil;
+    }
+
+    subscriptionStats_add(ctx, &response);
+
+    record->subscriptionId = response.subscriptionId;
+    record->lost = false;
+
+    for (size_t i = 0; i < itemCount; i++) {
+        rb_ary_push(v_previousItemIds, UINT2NUM(record->itemIds[i]));
+        previousIds[i] = record->itemIds[i];
+        record->itemIds[i] = 0;
+    }
+
+    recoverItems(call->client, &call->arena, record, chunk, statuses, itemContexts);
+    restoreTriggering(call->client, record, previousIds);
+
+    for (size_t i = 0; i < itemCount; i++) {
+        rb_ary_push(v_itemIds, record->itemIds[i] ? UINT2NUM(record->itemIds[i]) : Qnil);
+        rb_ary_push(v_statuses, UINT2NUM(statuses[i]));
+    }
+
+    rb_ary_push(v_recovered, UINT2NUM(previousId));
+    rb_ary_push(v_recovered, UINT2NUM(record->subscriptionId));
+    rb_ary_push(v_recovered, v_previousItemIds);
+    rb_ary_push(v_recovered, v_itemIds);
+    rb_ary_push(v_recovered, v_statuses);
+    return v_recovered;
+}
+
+/* Recovers the subscriptions open62541 dropped with the previous session by
+ * recreating them and their items in bulk. open62541 cannot adopt a
+ * subscription transferred from the old session, so that is not tried. All
+ * lost subscriptions are recovered before Ruby hears of any of them; those
+ * that could not be created, or all that remain if recovery raises, are
+ * tried again after the next cycle. Runs outside of client callbacks, after
+ * connect and run_mon_cycle. */
+static void recoverSubscriptions(VALUE self, UA_Client *client) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+    if (!ctx->recoveryPending) {
+        return;
+    }
+
+    UA_SessionState sessionState;
+    UA_Client_getState(client, NULL, &sessionState, NULL);
+    if (sessionState != UA_SESSIONSTATE_ACTIVATED) {
+        return;
+    }
+
+    readOperationLimits(client, &ctx->operationLimits);
+
+    VALUE v_recovered = rb_ary_new();
+    UA_Boolean pending = false;
+    for (struct SubscriptionRecord *record = ctx->subscriptionRecords; record; record = record->next) {
+        if (!record->lost) {
+            continue;
+        }
+
+        VALUE v_previousId = UINT2NUM(record->subscriptionId);
+        VALUE v_params = withRequestArena(self, recoverSubscription_body, &v_previousId, 0);
+        if (NIL_P(v_params)) {
+            pending = true;
+        } else {
+            rb_ary_push(v_recovered, v_params);
+        }
+    }
+    ctx->recoveryPending = pending;
+
+    /* The managed subscriptions of subscribe follow their ids first */
+    VALUE managed = rb_ivar_get(self, rb_intern("@callback_managed_subscription_recovered"));
+    VALUE callback = rb_ivar_get(self, rb_intern("@callback_after_subscription_recovered"));
+    for (long i = 0; i < RARRAY_LEN(v_recovered); i++) {
+        VALUE v_params = rb_ary_entry(v_recovered, i);
+
+        if (!NIL_P(managed)) {
+            rb_proc_call(managed, rb_ary_new_from_args(2, rb_ary_entry(v_params, 0), rb_ary_entry(v_params, 1)));
+        }
+        if (!NIL_P(callback)) {
+            rb_proc_call(callback, v_params);
+        }
+    }
+}
+
+static VALUE rb_getPreserveSubscriptions(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    return ctx->preserveSubscriptions ? Qtrue : Qfalse;
+}
+
+static VALUE rb_setPreserveSubscriptions(VALUE self, VALUE v_preserve) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    ctx->preserveSubscriptions = RTEST(v_preserve);
+    return v_preserve;
+}
+
+/* Notification ring buffer, Ruby side */
+
+static enum OverflowPolicy overflowPolicyFromSymbol(VALUE v_policy) {
+    Check_Type(v_policy, T_SYMBOL);
+    ID policy = SYM2ID(v_policy);
+
+    if (policy == rb_intern("drop_oldest")) {
+        return OVERFLOW_DROP_OLDEST;
+    } else if (policy == rb_intern("drop_newest")) {
+        return OVERFLOW_DROP_NEWEST;
+    } else if (policy == rb_intern("coalesce")) {
+        return OVERFLOW_COALESCE;
+    }
+
+    rb_raise(cError, "Unsupported overflow policy");
+}
+
+static VALUE overflowPolicyToSymbol(enum OverflowPolicy policy) {
+    switch (policy) {
+    case OVERFLOW_DROP_NEWEST: return ID2SYM(rb_intern("drop_newest"));
+    case OVERFLOW_COALESCE: return ID2SYM(rb_intern("coalesce"));
+    default: return ID2SYM(rb_intern("drop_oldest"));
     }
+}
+
+static VALUE rb_enableNotificationBuffer(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
 
-    UA_StatusCode status = multiWrite(client, nodes, values, namesCount);
+    VALUE v_capacity, v_policy;
+    rb_scan_args(argc, argv, "11", &v_capacity, &v_policy);
 
-    if (status == UA_STATUSCODE_GOOD) {
-        // printf("%s\n", "value write successful");
-    } else {
-        /* Clean up */
-        for (int i=0; i<namesCount; i++) {
-            UA_Variant_clear(&values[i]);
-        }
-        UA_free(nodes);
-        UA_free(values);
+    long capacity = NUM2LONG(v_capacity);
+    if (capacity <= 0) {
+        return raise_invalid_arguments_error();
+    }
+
+    enum OverflowPolicy policy = NIL_P(v_policy) ? OVERFLOW_DROP_OLDEST : overflowPolicyFromSymbol(v_policy);
 
+    UA_StatusCode status = notificationRing_init(&ctx->notificationRing, capacity, policy);
+    if (status != UA_STATUSCODE_GOOD) {
         return raise_ua_status_error(status);
     }
 
-    /* Clean up */
-    for (int i=0; i<namesCount; i++) {
-        UA_Variant_clear(&values[i]);
-    }
-    UA_free(nodes);
-    UA_free(values);
+    return Qnil;
+}
+
+static VALUE rb_disableNotificationBuffer(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
 
+    notificationRing_free(&ctx->notificationRing);
     return Qnil;
 }
 
-static VALUE rb_writeUaValue(VALUE self, VALUE v_nsIndex, VALUE v_name, VALUE v_newValue, int uaType) {
-    if (RB_TYPE_P(v_name, T_STRING) != 1) {
-        return raise_invalid_arguments_error();
+/* Removes up to max (default all) notifications, as the same columns as
+ * after_data_changed_batch */
+static VALUE rb_drainNotifications(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct NotificationRing *ring = &ctx->notificationRing;
+
+    VALUE v_max;
+    rb_scan_args(argc, argv, "01", &v_max);
+
+    size_t count = ring->count;
+    if (!NIL_P(v_max) && NUM2SIZET(v_max) < count) {
+        count = NUM2SIZET(v_max);
     }
 
-    if (RB_TYPE_P(v_nsIndex, T_FIXNUM) != 1) {
-        return raise_invalid_arguments_error();
+    VALUE columns[NOTIFICATION_COLUMNS];
+    notificationColumns_init(columns, count);
+    UA_DateTime now = UA_DateTime_now();
+
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = ring->head;
+        if (ctx->latency.enabled) {
+            latency_delivered(&ctx->latency, &ring->values[slot], ring->received[slot], now);
+        }
+        notificationColumns_push(columns, ring->subscriptionIds[slot], ring->monitoredItemIds[slot],
+                                 (enum TimestampFormat)ring->timestampFormats[slot], &ring->values[slot]);
+        notificationRing_pop(ring);
     }
 
-    if (uaType == UA_TYPES_INT16 && RB_TYPE_P(v_newValue, T_FIXNUM) != 1) {
+    return rb_ary_new_from_values(NOTIFICATION_COLUMNS, columns);
+}
+
+static VALUE rb_notificationBufferStats(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct NotificationRing *ring = &ctx->notificationRing;
+
+    VALUE stats = rb_hash_new();
+    rb_hash_aset(stats, ID2SYM(rb_intern("enabled")), ring->enabled ? Qtrue : Qfalse);
+    rb_hash_aset(stats, ID2SYM(rb_intern("capacity")), SIZET2NUM(ring->capacity));
+    rb_hash_aset(stats, ID2SYM(rb_intern("overflow")), overflowPolicyToSymbol(ring->policy));
+    rb_hash_aset(stats, ID2SYM(rb_intern("depth")), SIZET2NUM(ring->count));
+    rb_hash_aset(stats, ID2SYM(rb_intern("high_water")), SIZET2NUM(ring->highWater));
+    rb_hash_aset(stats, ID2SYM(rb_intern("pushed")), ULL2NUM(ring->pushed));
+    rb_hash_aset(stats, ID2SYM(rb_intern("dropped")), ULL2NUM(ring->dropped));
+    rb_hash_aset(stats, ID2SYM(rb_intern("coalesced")), ULL2NUM(ring->coalesced));
+    return stats;
+}
+
+static VALUE rb_enableWriteDedup(int argc, VALUE *argv, VALUE self) {
+    VALUE v_deadband;
+    rb_scan_args(argc, argv, "01", &v_deadband);
+
+    UA_Double deadband = NIL_P(v_deadband) ? 0 : NUM2DBL(v_deadband);
+    if (deadband < 0) {
         return raise_invalid_arguments_error();
     }
 
-    char *name = StringValueCStr(v_name);
-    int nsIndex = FIX2INT(v_nsIndex);
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
 
+    ctx->writeShadow.enabled = true;
+    ctx->writeShadow.deadband = deadband;
+    return Qnil;
+}
+
+static VALUE rb_disableWriteDedup(VALUE self) {
     struct UninitializedClient * uclient;
     TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
-    UA_Client *client = uclient->client;
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
 
-    UA_Variant value;
-    UA_Variant_init(&value);
+    writeShadow_free(&ctx->writeShadow);
+    ctx->writeShadow.enabled = false;
+    return Qnil;
+}
 
-    if (uaType == UA_TYPES_BYTE) {
-        UA_Byte newValue = NUM2CHR(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Byte));
-        *(UA_Byte*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_BYTE];
-    } else if (uaType == UA_TYPES_SBYTE) {
-        UA_SByte newValue = NUM2INT(v_newValue);
-        value.data = UA_malloc(sizeof(UA_SByte));
-        *(UA_SByte*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_SBYTE];
-    } else if (uaType == UA_TYPES_INT16) {
-        UA_Int16 newValue = NUM2SHORT(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Int16));
-        *(UA_Int16*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_INT16];
-    } else if (uaType == UA_TYPES_UINT16) {
-        UA_UInt16 newValue = NUM2USHORT(v_newValue);
-        value.data = UA_malloc(sizeof(UA_UInt16));
-        *(UA_UInt16*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_UINT16];
-    } else if (uaType == UA_TYPES_INT32) {
-        UA_Int32 newValue = NUM2INT(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Int32));
-        *(UA_Int32*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_INT32];
-    } else if (uaType == UA_TYPES_UINT32) {
-        UA_UInt32 newValue = NUM2UINT(v_newValue);
-        value.data = UA_malloc(sizeof(UA_UInt32));
-        *(UA_UInt32*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_UINT32];
-    } else if (uaType == UA_TYPES_INT64) {
-        UA_Int64 newValue = NUM2LL(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Int64));
-        *(UA_Int64*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_INT64];
-    } else if (uaType == UA_TYPES_UINT64) {
-        UA_UInt64 newValue = NUM2ULL(v_newValue);
-        value.data = UA_malloc(sizeof(UA_UInt64));
-        *(UA_UInt64*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_UINT64];
-    } else if (uaType == UA_TYPES_FLOAT) {
-        UA_Float newValue = NUM2DBL(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Float));
-        *(UA_Float*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_FLOAT];
-    } else if (uaType == UA_TYPES_DOUBLE) {
-        UA_Double newValue = NUM2DBL(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Double));
-        *(UA_Double*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_DOUBLE];
-    } else if (uaType == UA_TYPES_BOOLEAN) {
-        UA_Boolean newValue = RTEST(v_newValue);
-        value.data = UA_malloc(sizeof(UA_Boolean));
-        *(UA_Boolean*)value.data = newValue;
-        value.type = &UA_TYPES[UA_TYPES_BOOLEAN];
-    } else if (uaType == UA_TYPES_STRING) {
-        char *str = StringValueCStr(v_newValue);
-        UA_String *uaString = UA_malloc(sizeof(UA_String));
-        *uaString = UA_STRING_ALLOC(str);
-        value.data = uaString;
-        value.type = &UA_TYPES[UA_TYPES_STRING];
-    } else {
-        rb_raise(cError, "Unsupported type");
-    }
+static VALUE rb_writeDedupStats(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct WriteShadow *shadow = &ctx->writeShadow;
+
+    VALUE stats = rb_hash_new();
+    rb_hash_aset(stats, ID2SYM(rb_intern("enabled")), shadow->enabled ? Qtrue : Qfalse);
+    rb_hash_aset(stats, ID2SYM(rb_intern("deadband")), DBL2NUM(shadow->deadband));
+    rb_hash_aset(stats, ID2SYM(rb_intern("nodes")), ULONG2NUM(shadow->index.count));
+    rb_hash_aset(stats, ID2SYM(rb_intern("hits")), ULL2NUM(shadow->hits));
+    rb_hash_aset(stats, ID2SYM(rb_intern("misses")), ULL2NUM(shadow->misses));
+    return stats;
+}
 
-    UA_StatusCode status = UA_Client_writeValueAttribute(client, UA_NODEID_STRING(nsIndex, name), &value);
+/* Fill a (borrowed) array buffer from a Ruby Array, one element at a time */
+static void fillUaArrayFromRubyArray(void *array, VALUE v_array, long arrayLength, UA_UInt32 uaType) {
+    for (long i = 0; i < arrayLength; i++) {
+        VALUE elem = rb_ary_entry(v_array, i);
 
-    if (status == UA_STATUSCODE_GOOD) {
-        // printf("%s\n", "value write successful");
-    } else {
-        /* Clean up */
-        UA_Variant_clear(&value);
-        return raise_ua_status_error(status);
+        if (uaType == UA_TYPES_BYTE) {
+            ((UA_Byte*)array)[i] = NUM2CHR(elem);
+        } else if (uaType == UA_TYPES_SBYTE) {
+            ((UA_SByte*)array)[i] = NUM2INT(elem);
+        } else if (uaType == UA_TYPES_INT16) {
+            ((UA_Int16*)array)[i] = NUM2SHORT(elem);
+        } else if (uaType == UA_TYPES_UINT16) {
+            ((UA_UInt16*)array)[i] = NUM2USHORT(elem);
+        } else if (uaType == UA_TYPES_INT32) {
+            ((UA_Int32*)array)[i] = NUM2INT(elem);
+        } else if (uaType == UA_TYPES_UINT32) {
+            ((UA_UInt32*)array)[i] = NUM2UINT(elem);
+        } else if (uaType == UA_TYPES_INT64) {
+            ((UA_Int64*)array)[i] = NUM2LL(elem);
+        } else if (uaType == UA_TYPES_UINT64) {
+            ((UA_UInt64*)array)[i] = NUM2ULL(elem);
+        } else if (uaType == UA_TYPES_FLOAT) {
+            ((UA_Float*)array)[i] = NUM2DBL(elem);
+        } else if (uaType == UA_TYPES_DOUBLE) {
+            ((UA_Double*)array)[i] = NUM2DBL(elem);
+        } else if (uaType == UA_TYPES_BOOLEAN) {
+            ((UA_Boolean*)array)[i] = RTEST(elem);
+        } else if (uaType == UA_TYPES_STRING) {
+            /* Borrow the Ruby string memory, the element keeps it alive */
+            Check_Type(elem, T_STRING);
+            UA_String *str = &((UA_String*)array)[i];
+            str->length = RSTRING_LEN(elem);
+            str->data = (UA_Byte*)RSTRING_PTR(elem);
+        }
     }
+}
 
-    /* Clean up */
-    UA_Variant_clear(&value);
+/* Get the raw bytes of a packed String or IO::Buffer of little-endian values.
+ * Returns false if v_packed is neither. */
+static UA_Boolean getPackedBytes(VALUE v_packed, const void **base, size_t *size) {
+    if (RB_TYPE_P(v_packed, T_STRING)) {
+        *base = RSTRING_PTR(v_packed);
+        *size = RSTRING_LEN(v_packed);
+        return true;
+    }
 
-    return Qnil;
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_READING
+    if (rb_obj_is_kind_of(v_packed, rb_cIOBuffer)) {
+        rb_io_buffer_get_bytes_for_reading(v_packed, base, size);
+        return true;
+    }
+#endif
+
+    return false;
 }
 
 static VALUE rb_writeUaArrayValue(VALUE self, VALUE v_nsIndex, VALUE v_name, VALUE v_newArray, UA_UInt32 uaType) {
@@ -730,128 +4894,78 @@ static VALUE rb_writeUaArrayValue(VALUE self, VALUE v_nsIndex, VALUE v_name, VAL
     UA_Int16 nsIndex = NUM2INT(v_nsIndex);
     char *name = StringValueCStr(v_name);
 
-    /* Check that v_newArray is an array */
-    Check_Type(v_newArray, T_ARRAY);
-    long arrayLength = RARRAY_LEN(v_newArray);
+    switch (uaType) {
+        case UA_TYPES_BYTE: case UA_TYPES_SBYTE:
+        case UA_TYPES_INT16: case UA_TYPES_UINT16:
+        case UA_TYPES_INT32: case UA_TYPES_UINT32:
+        case UA_TYPES_INT64: case UA_TYPES_UINT64:
+        case UA_TYPES_FLOAT: case UA_TYPES_DOUBLE:
+        case UA_TYPES_BOOLEAN: case UA_TYPES_STRING:
+            break;
+        default:
+            rb_raise(cError, "Unsupported type");
+            return Qnil;
+    }
+
+    const UA_DataType *type = &UA_TYPES[uaType];
+    void *array = NULL;
+    long arrayLength = 0;
+    VALUE v_tmp = 0;
 
-    /* Prepare variant */
-    UA_Variant value;
-    UA_Variant_init(&value);
+    const void *packed;
+    size_t packedSize;
 
-    /* Allocate and populate array based on type */
-    if (uaType == UA_TYPES_BYTE) {
-        UA_Byte *array = (UA_Byte*)UA_malloc(sizeof(UA_Byte) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2CHR(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_BYTE]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_SBYTE) {
-        UA_SByte *array = (UA_SByte*)UA_malloc(sizeof(UA_SByte) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2INT(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_SBYTE]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_INT16) {
-        UA_Int16 *array = (UA_Int16*)UA_malloc(sizeof(UA_Int16) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2SHORT(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_INT16]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_UINT16) {
-        UA_UInt16 *array = (UA_UInt16*)UA_malloc(sizeof(UA_UInt16) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2USHORT(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_UINT16]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_INT32) {
-        UA_Int32 *array = (UA_Int32*)UA_malloc(sizeof(UA_Int32) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2INT(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_INT32]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_UINT32) {
-        UA_UInt32 *array = (UA_UInt32*)UA_malloc(sizeof(UA_UInt32) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2UINT(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_UINT32]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_INT64) {
-        UA_Int64 *array = (UA_Int64*)UA_malloc(sizeof(UA_Int64) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2LL(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_INT64]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_UINT64) {
-        UA_UInt64 *array = (UA_UInt64*)UA_malloc(sizeof(UA_UInt64) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2ULL(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_UINT64]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_FLOAT) {
-        UA_Float *array = (UA_Float*)UA_malloc(sizeof(UA_Float) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2DBL(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_FLOAT]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_DOUBLE) {
-        UA_Double *array = (UA_Double*)UA_malloc(sizeof(UA_Double) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = NUM2DBL(elem);
-        }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_DOUBLE]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_BOOLEAN) {
-        UA_Boolean *array = (UA_Boolean*)UA_malloc(sizeof(UA_Boolean) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            array[i] = RTEST(elem);
+    if (getPackedBytes(v_newArray, &packed, &packedSize)) {
+        /* Packed little-endian values are encoded straight from their memory */
+#if UA_BINARY_OVERLAYABLE_INTEGER && UA_BINARY_OVERLAYABLE_FLOAT
+        if (uaType == UA_TYPES_STRING) {
+            rb_raise(cError, "Packed buffers are not supported for string arrays");
         }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_BOOLEAN]);
-        UA_free(array);
-    } else if (uaType == UA_TYPES_STRING) {
-        UA_String *array = (UA_String*)UA_malloc(sizeof(UA_String) * arrayLength);
-        for (long i = 0; i < arrayLength; i++) {
-            VALUE elem = rb_ary_entry(v_newArray, i);
-            char *str = StringValueCStr(elem);
-            array[i] = UA_STRING_ALLOC(str);
+
+        if (packedSize % type->memSize != 0) {
+            rb_raise(cError, "Packed buffer size %zu is not a multiple of %u", packedSize, type->memSize);
         }
-        UA_Variant_setArrayCopy(&value, array, arrayLength, &UA_TYPES[UA_TYPES_STRING]);
-        for (long i = 0; i < arrayLength; i++) {
-            UA_String_clear(&array[i]);
+
+        arrayLength = packedSize / type->memSize;
+
+        /* Ruby does not align String memory for the element type */
+        if ((uintptr_t)packed % type->memSize == 0) {
+            array = (void*)packed;
+        } else {
+            array = ALLOCV(v_tmp, packedSize);
+            memcpy(array, packed, packedSize);
         }
-        UA_free(array);
+#else
+        rb_raise(cError, "Packed buffers require a little-endian host");
+#endif
     } else {
-        rb_raise(cError, "Unsupported type");
-        return Qnil;
+        /* Check that v_newArray is an array */
+        Check_Type(v_newArray, T_ARRAY);
+        arrayLength = RARRAY_LEN(v_newArray);
+
+        /* Fill a temporary buffer owned by Ruby, so a raise while converting
+         * elements does not leak. The variant borrows it without copying. */
+        array = ALLOCV(v_tmp, type->memSize * arrayLength);
+        fillUaArrayFromRubyArray(array, v_newArray, arrayLength, uaType);
     }
 
+    /* Prepare variant */
+    UA_Variant value;
+    UA_Variant_init(&value);
+    UA_Variant_setArray(&value, arrayLength > 0 ? array : UA_EMPTY_ARRAY_SENTINEL, arrayLength, type);
+    value.storageType = UA_VARIANT_DATA_NODELETE;
+
     UA_StatusCode status = UA_Client_writeValueAttribute(client, UA_NODEID_STRING(nsIndex, name), &value);
 
+    if (v_tmp) {
+        ALLOCV_END(v_tmp);
+    }
+    RB_GC_GUARD(v_newArray);
+
     if (status != UA_STATUSCODE_GOOD) {
-        UA_Variant_clear(&value);
         return raise_ua_status_error(status);
     }
 
-    UA_Variant_clear(&value);
     return Qnil;
 }
 
@@ -1284,12 +5398,43 @@ static VALUE rb_get_human_UA_StatusCode(VALUE self, VALUE v_code) {
     }
 }
 
+/* One client iteration, then the collected notification batch is delivered */
+static UA_StatusCode runMonitoringCycle(VALUE self, UA_Client *client) {
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+
+    VALUE batchCallback = rb_ivar_get(self, rb_intern("@callback_after_data_changed_batch"));
+    ctx->batchEnabled = !NIL_P(batchCallback);
+
+    UA_Boolean reconnecting = ctx->reconnect.enabled && ctx->reconnect.wanted &&
+                              ctx->reconnect.state != CONNECTION_CONNECTED;
+    if (reconnecting) {
+        UA_StatusCode status = reconnect_run(self, client);
+        if (status != UA_STATUSCODE_GOOD) {
+            return status;
+        }
+    }
+
+    UA_StatusCode status = UA_Client_run_iterate(client, 1000);
+
+    notificationBatch_deliver(ctx, batchCallback);
+    writeQueue_deliver(self, ctx);
+    connectionState_update(self, client);
+    recoverSubscriptions(self, client);
+    health_update(self, &ctx->health);
+
+    /* Still down while the attempt goes on */
+    if (reconnecting && status == UA_STATUSCODE_GOOD && ctx->reconnect.state != CONNECTION_CONNECTED) {
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    }
+    return status;
+}
+
 static VALUE rb_run_single_monitoring_cycle(VALUE self) {
     struct UninitializedClient * uclient;
     TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
     UA_Client *client = uclient->client;
 
-    UA_StatusCode status = UA_Client_run_iterate(client, 1000);
+    UA_StatusCode status = runMonitoringCycle(self, client);
     return UINT2NUM(status);
 }
 
@@ -1298,7 +5443,7 @@ static VALUE rb_run_single_monitoring_cycle_bang(VALUE self) {
     TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
     UA_Client *client = uclient->client;
 
-    UA_StatusCode status = UA_Client_run_iterate(client, 1000);
+    UA_StatusCode status = runMonitoringCycle(self, client);
 
     if (status != UA_STATUSCODE_GOOD) {
         return raise_ua_status_error(status);
@@ -1321,6 +5466,299 @@ static VALUE rb_state(VALUE self) {
     return INT2NUM(sessionState);
 }
 
+/* Per subscription counters since creation; the rate covers the time since
+ * the previous call */
+static VALUE rb_subscriptionStats(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct SubscriptionStatsTable *table = &ctx->subscriptionStats;
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    VALUE v_result = rb_hash_new();
+
+    for (size_t i = 0; i < table->count; i++) {
+        struct SubscriptionStats *stats = &table->entries[i];
+
+        UA_Double elapsed = (UA_Double)(now - stats->lastScrape) / UA_DATETIME_SEC;
+        UA_Double rate = elapsed > 0 ? (stats->notifications - stats->scrapeNotifications) / elapsed : 0.0;
+        stats->lastScrape = now;
+        stats->scrapeNotifications = stats->notifications;
+
+        VALUE v_stats = rb_hash_new();
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("publishing_interval")), DBL2NUM(stats->publishingInterval));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("keepalive_count")), UINT2NUM(stats->keepAliveCount));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("lifetime_count")), UINT2NUM(stats->lifetimeCount));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("notifications")), ULL2NUM(stats->notifications));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("notification_rate")), DBL2NUM(rate));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("events")), ULL2NUM(stats->events));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("overflows")), ULL2NUM(stats->overflows));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("status_changes")), ULL2NUM(stats->statusChanges));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("last_status")), UINT2NUM(stats->lastStatus));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("inactivity")), ULL2NUM(stats->inactivity));
+        rb_hash_aset(v_stats, ID2SYM(rb_intern("idle_seconds")),
+                     DBL2NUM((UA_Double)(now - (stats->lastNotification ? stats->lastNotification : stats->created)) / UA_DATETIME_SEC));
+        rb_hash_aset(v_result, UINT2NUM(stats->subscriptionId), v_stats);
+    }
+
+    return v_result;
+}
+
+/* Latency histograms, Ruby side */
+
+static VALUE rb_getMeasureLatency(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    return ctx->latency.enabled ? Qtrue : Qfalse;
+}
+
+static VALUE rb_setMeasureLatency(VALUE self, VALUE v_enabled) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    ctx->latency.enabled = RTEST(v_enabled);
+    return v_enabled;
+}
+
+static VALUE latencyHistogram_toRuby(const struct LatencyHistogram *histogram) {
+    VALUE v_buckets = rb_ary_new_capa(LATENCY_BUCKETS);
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        rb_ary_push(v_buckets, ULL2NUM(histogram->buckets[i]));
+    }
+
+    VALUE v_histogram = rb_hash_new();
+    rb_hash_aset(v_histogram, ID2SYM(rb_intern("count")), ULL2NUM(histogram->count));
+    rb_hash_aset(v_histogram, ID2SYM(rb_intern("mean")),
+                 histogram->count ? DBL2NUM((UA_Double)histogram->sum / histogram->count / UA_DATETIME_SEC) : Qnil);
+    rb_hash_aset(v_histogram, ID2SYM(rb_intern("max")),
+                 histogram->count ? DBL2NUM((UA_Double)histogram->max / UA_DATETIME_SEC) : Qnil);
+    rb_hash_aset(v_histogram, ID2SYM(rb_intern("negative")), ULL2NUM(histogram->negative));
+    rb_hash_aset(v_histogram, ID2SYM(rb_intern("buckets")), v_buckets);
+    return v_histogram;
+}
+
+static VALUE rb_latencyHistograms(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct LatencyTracking *latency = &ctx->latency;
+
+    static const char *names[LATENCY_STAGES] = {
+        "source_to_server", "server_to_receipt", "receipt_to_callback", "source_to_callback"
+    };
+
+    VALUE v_result = rb_hash_new();
+    for (int i = 0; i < LATENCY_STAGES; i++) {
+        rb_hash_aset(v_result, ID2SYM(rb_intern(names[i])), latencyHistogram_toRuby(&latency->stages[i]));
+    }
+    rb_hash_aset(v_result, ID2SYM(rb_intern("clock_offset")),
+                 latency->offsetKnown ? DBL2NUM((UA_Double)latency->clockOffset / UA_DATETIME_SEC) : Qnil);
+    return v_result;
+}
+
+static VALUE rb_resetLatencyHistograms(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    memset(ctx->latency.stages, 0, sizeof(ctx->latency.stages));
+    return Qnil;
+}
+
+/* Server clock minus local clock, from the ServerStatus.CurrentTime read
+ * with the shortest round trip, assuming symmetric network delays */
+static VALUE rb_estimateClockOffset(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+    struct OpcuaClientContext *ctx = UA_Client_getContext(client);
+
+    VALUE v_samples;
+    rb_scan_args(argc, argv, "01", &v_samples);
+    int samples = NIL_P(v_samples) ? 5 : NUM2INT(v_samples);
+    if (samples < 1) {
+        return raise_invalid_arguments_error();
+    }
+
+    UA_DateTime bestRoundTrip = 0;
+    UA_DateTime bestOffset = 0;
+    UA_StatusCode status = UA_STATUSCODE_GOOD;
+    UA_Boolean measured = false;
+
+    for (int i = 0; i < samples; i++) {
+        UA_Variant value;
+        UA_Variant_init(&value);
+
+        UA_DateTime sent = UA_DateTime_now();
+        status = UA_Client_readValueAttribute(client, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME),
+                                              &value);
+        UA_DateTime received = UA_DateTime_now();
+
+        if (status == UA_STATUSCODE_GOOD && UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_DATETIME])) {
+            UA_DateTime roundTrip = received - sent;
+            if (!measured || roundTrip < bestRoundTrip) {
+                bestRoundTrip = roundTrip;
+                bestOffset = *(UA_DateTime*)value.data - (sent + roundTrip / 2);
+                measured = true;
+            }
+        }
+        UA_Variant_clear(&value);
+    }
+
+    if (!measured) {
+        return raise_ua_status_error(status != UA_STATUSCODE_GOOD ? status : UA_STATUSCODE_BADTYPEMISMATCH);
+    }
+
+    ctx->latency.clockOffset = bestOffset;
+    ctx->latency.offsetKnown = true;
+
+    VALUE v_result = rb_hash_new();
+    rb_hash_aset(v_result, ID2SYM(rb_intern("offset")), DBL2NUM((UA_Double)bestOffset / UA_DATETIME_SEC));
+    rb_hash_aset(v_result, ID2SYM(rb_intern("round_trip")), DBL2NUM((UA_Double)bestRoundTrip / UA_DATETIME_SEC));
+    return v_result;
+}
+
+/* Connection health monitor, Ruby side */
+
+static VALUE rb_enableHealthMonitor(int argc, VALUE *argv, VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    UA_Client *client = uclient->client;
+    struct HealthMonitor *health = &((struct OpcuaClientContext *)UA_Client_getContext(client))->health;
+
+    VALUE v_options;
+    rb_scan_args(argc, argv, "0:", &v_options);
+
+    static const char *const names[3] = { "interval", "rtt_threshold", "failure_threshold" };
+    VALUE values[3];
+    keywordsFromRuby(v_options, names, 3, values);
+
+    UA_Double interval = values[0] != Qundef ? NUM2DBL(values[0]) : 5.0;
+    UA_Double rttThreshold = values[1] != Qundef && !NIL_P(values[1]) ? NUM2DBL(values[1]) : 0;
+    int failureThreshold = values[2] != Qundef ? NUM2INT(values[2]) : 3;
+
+    if (interval <= 0 || rttThreshold < 0 || failureThreshold < 1) {
+        rb_raise(rb_eArgError, "expected interval > 0, rtt_threshold >= 0 and failure_threshold >= 1");
+    }
+
+    if (health->enabled) {
+        UA_Client_removeCallback(client, health->callbackId);
+    }
+    /* A probe still in flight is answered into the fresh statistics */
+    UA_Boolean probing = health->probing;
+    UA_DateTime sent = health->sent;
+    *health = (const struct HealthMonitor){ 0 };
+    health->probing = probing;
+    health->sent = sent;
+    health->interval = (UA_DateTime)(interval * UA_DATETIME_SEC);
+    health->rttThreshold = (UA_DateTime)(rttThreshold * UA_DATETIME_SEC);
+    health->failureThreshold = (UA_UInt32)failureThreshold;
+    health->alive = true;
+    health->reportedAlive = true;
+
+    UA_StatusCode status = UA_Client_addRepeatedCallback(client, health_probe, NULL, interval * 1000.0,
+                                                         &health->callbackId);
+    if (status != UA_STATUSCODE_GOOD) {
+        return raise_ua_status_error(status);
+    }
+    health->enabled = true;
+    return Qnil;
+}
+
+static VALUE rb_disableHealthMonitor(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct HealthMonitor *health = &((struct OpcuaClientContext *)UA_Client_getContext(uclient->client))->health;
+
+    if (health->enabled) {
+        UA_Client_removeCallback(uclient->client, health->callbackId);
+        health->enabled = false;
+    }
+    return Qnil;
+}
+
+static VALUE rb_healthStats(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct HealthMonitor *health = &((struct OpcuaClientContext *)UA_Client_getContext(uclient->client))->health;
+
+    struct LatencyHistogram rtt = { 0 };
+    for (size_t i = 0; i < health->sampleCount; i++) {
+        latencyHistogram_add(&rtt, health->samples[i]);
+    }
+
+    VALUE v_result = rb_hash_new();
+    rb_hash_aset(v_result, ID2SYM(rb_intern("enabled")), health->enabled ? Qtrue : Qfalse);
+    rb_hash_aset(v_result, ID2SYM(rb_intern("alive")), health->known ? (health->alive ? Qtrue : Qfalse) : Qnil);
+    rb_hash_aset(v_result, ID2SYM(rb_intern("slow")), health->slow ? Qtrue : Qfalse);
+    rb_hash_aset(v_result, ID2SYM(rb_intern("probes")), ULL2NUM(health->probes));
+    rb_hash_aset(v_result, ID2SYM(rb_intern("failures")), ULL2NUM(health->failures));
+    rb_hash_aset(v_result, ID2SYM(rb_intern("consecutive_failures")), UINT2NUM(health->consecutiveFailures));
+    rb_hash_aset(v_result, ID2SYM(rb_intern("last_status")), UINT2NUM(health->lastStatus));
+    rb_hash_aset(v_result, ID2SYM(rb_intern("last_rtt")),
+                 health->sampleCount ? DBL2NUM((UA_Double)health->lastRtt / UA_DATETIME_SEC) : Qnil);
+    rb_hash_aset(v_result, ID2SYM(rb_intern("rtt")), latencyHistogram_toRuby(&rtt));
+    return v_result;
+}
+
+/* Columns of the items silent for longer than expected: subscription ids,
+ * monitored item ids, tags and seconds since the last notification */
+static VALUE rb_staleItems(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    struct Staleness *staleness = &ctx->staleness;
+
+    VALUE columns[4];
+    for (int i = 0; i < 4; i++) {
+        columns[i] = rb_ary_new();
+    }
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    for (size_t i = 0; i < staleness->count; i++) {
+        const struct StalenessEntry *entry = &staleness->entries[i];
+        UA_DateTime silence = now - entry->lastUpdate;
+        if (silence <= entry->maxSilence) {
+            continue;
+        }
+
+        rb_ary_push(columns[0], UINT2NUM(entry->subscriptionId));
+        rb_ary_push(columns[1], UINT2NUM(entry->monitoredItemId));
+        rb_ary_push(columns[2], entry->item->tag);
+        rb_ary_push(columns[3], DBL2NUM((UA_Double)silence / UA_DATETIME_SEC));
+    }
+
+    return rb_ary_new_from_values(4, columns);
+}
+
+static VALUE rb_getTimestampFormat(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    return timestampFormatToSymbol(ctx->timestampFormat);
+}
+
+static VALUE rb_setTimestampFormat(VALUE self, VALUE v_format) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+    ctx->timestampFormat = timestampFormatFromSymbol(v_format);
+    return v_format;
+}
+
+static VALUE rb_requestArenaStats(VALUE self) {
+    struct UninitializedClient * uclient;
+    TypedData_Get_Struct(self, struct UninitializedClient, &UA_Client_Type, uclient);
+    struct OpcuaClientContext *ctx = UA_Client_getContext(uclient->client);
+
+    VALUE stats = rb_hash_new();
+    rb_hash_aset(stats, ID2SYM(rb_intern("requests")), ULL2NUM(ctx->arenaStats.requests));
+    rb_hash_aset(stats, ID2SYM(rb_intern("allocations")), ULL2NUM(ctx->arenaStats.allocations));
+    rb_hash_aset(stats, ID2SYM(rb_intern("blocks")), ULL2NUM(ctx->arenaStats.blocks));
+    rb_hash_aset(stats, ID2SYM(rb_intern("bytes")), ULL2NUM(ctx->arenaStats.bytes));
+    return stats;
+}
+
 static void defineStateContants(VALUE mOPCUAClient) {
     /* Session state constants */
     rb_define_const(mOPCUAClient, "UA_SESSIONSTATE_CLOSED", INT2NUM(UA_SESSIONSTATE_CLOSED));
@@ -1348,12 +5786,14 @@ void Init_opcua_client()
 
     cError = rb_define_class_under(mOPCUAClient, "Error", rb_eStandardError);
     rb_global_variable(&cError);
+    endpointCacheLock = rb_mutex_new();
+    rb_global_variable(&endpointCacheLock);
     cClient = rb_define_class_under(mOPCUAClient, "Client", rb_cObject);
     rb_global_variable(&cClient);
 
     rb_define_alloc_func(cClient, allocate);
 
-    rb_define_method(cClient, "initialize", rb_initialize, 0);
+    rb_define_method(cClient, "initialize", rb_initialize, -1);
 
     rb_define_method(cClient, "run_single_monitoring_cycle", rb_run_single_monitoring_cycle, 0);
     rb_define_method(cClient, "run_mon_cycle", rb_run_single_monitoring_cycle, 0);
@@ -1363,9 +5803,27 @@ void Init_opcua_client()
     rb_define_method(cClient, "run_mon_cycle!", rb_run_single_monitoring_cycle_bang, 0);
     rb_define_method(cClient, "do_mon_cycle!", rb_run_single_monitoring_cycle_bang, 0);
 
-    rb_define_method(cClient, "connect", rb_connect, 1);
+    rb_define_method(cClient, "connect", rb_connect, -1);
+    rb_define_method(cClient, "session_credentials", rb_sessionCredentials, 0);
+    rb_define_singleton_method(cClient, "clear_endpoint_cache", rb_clearEndpointCache, 0);
     rb_define_method(cClient, "disconnect", rb_disconnect, 0);
+    rb_define_method(cClient, "enable_auto_reconnect", rb_enableAutoReconnect, -1);
+    rb_define_method(cClient, "disable_auto_reconnect", rb_disableAutoReconnect, 0);
+    rb_define_method(cClient, "connection_state", rb_connectionState, 0);
+    rb_define_method(cClient, "enable_health_monitor", rb_enableHealthMonitor, -1);
+    rb_define_method(cClient, "disable_health_monitor", rb_disableHealthMonitor, 0);
+    rb_define_method(cClient, "health_stats", rb_healthStats, 0);
     rb_define_method(cClient, "state", rb_state, 0);
+    rb_define_method(cClient, "request_arena_stats", rb_requestArenaStats, 0);
+    rb_define_method(cClient, "operation_limits", rb_operationLimits, 0);
+
+    rb_define_method(cClient, "measure_latency", rb_getMeasureLatency, 0);
+    rb_define_method(cClient, "measure_latency=", rb_setMeasureLatency, 1);
+    rb_define_method(cClient, "latency_histograms", rb_latencyHistograms, 0);
+    rb_define_method(cClient, "reset_latency_histograms", rb_resetLatencyHistograms, 0);
+    rb_define_method(cClient, "estimate_clock_offset", rb_estimateClockOffset, -1);
+    rb_define_method(cClient, "timestamps", rb_getTimestampFormat, 0);
+    rb_define_method(cClient, "timestamps=", rb_setTimestampFormat, 1);
 
     rb_define_method(cClient, "read_byte", rb_readByteValue, 2);
     rb_define_method(cClient, "read_sbyte", rb_readSByteValue, 2);
@@ -1453,10 +5911,42 @@ void Init_opcua_client()
     rb_define_method(cClient, "multi_write_boolean", rb_writeBooleanValues, 3);
     rb_define_method(cClient, "multi_write_bool", rb_writeBooleanValues, 3);
 
-    rb_define_method(cClient, "multi_read", rb_readUaValues, 2);
-
-    rb_define_method(cClient, "create_subscription", rb_createSubscription, 0);
-    rb_define_method(cClient, "add_monitored_item", rb_addMonitoredItem, 3);
+    rb_define_method(cClient, "multi_read", rb_readUaValues, -1);
+    rb_define_method(cClient, "multi_write_data_values", rb_writeDataValues, -1);
+    rb_define_method(cClient, "write_chunk_size", rb_getWriteChunkSize, 0);
+    rb_define_method(cClient, "write_chunk_size=", rb_setWriteChunkSize, 1);
+
+    rb_define_method(cClient, "enqueue_write", rb_enqueueWrite, 4);
+    rb_define_method(cClient, "flush_writes", rb_flushWrites, 0);
+    rb_define_method(cClient, "auto_flush_writes", rb_autoFlushWrites, 1);
+    rb_define_method(cClient, "write_queue_stats", rb_writeQueueStats, 0);
+
+    rb_define_method(cClient, "enable_write_dedup", rb_enableWriteDedup, -1);
+    rb_define_method(cClient, "disable_write_dedup", rb_disableWriteDedup, 0);
+    rb_define_method(cClient, "write_dedup_stats", rb_writeDedupStats, 0);
+
+    rb_define_method(cClient, "outstanding_publish_requests", rb_getOutstandingPublishRequests, 0);
+    rb_define_method(cClient, "outstanding_publish_requests=", rb_setOutstandingPublishRequests, 1);
+    rb_define_method(cClient, "queue_size", rb_getQueueSize, 0);
+    rb_define_method(cClient, "queue_size=", rb_setQueueSize, 1);
+
+    rb_define_method(cClient, "create_subscription", rb_createSubscription, -1);
+    rb_define_method(cClient, "add_monitored_item", rb_addMonitoredItem, -1);
+    rb_define_method(cClient, "add_monitored_items", rb_addMonitoredItems, -1);
+    rb_define_method(cClient, "modify_monitored_items", rb_modifyMonitoredItems, 3);
+    rb_define_method(cClient, "delete_monitored_items", rb_deleteMonitoredItems, 2);
+    rb_define_method(cClient, "set_monitoring_mode", rb_setMonitoringMode, 3);
+    rb_define_method(cClient, "delete_subscriptions", rb_deleteSubscriptions, 1);
+    rb_define_method(cClient, "set_triggering", rb_setTriggering, -1);
+    rb_define_method(cClient, "add_event_monitored_item", rb_addEventMonitoredItem, -1);
+    rb_define_method(cClient, "subscription_stats", rb_subscriptionStats, 0);
+    rb_define_method(cClient, "stale_items", rb_staleItems, 0);
+    rb_define_method(cClient, "preserve_subscriptions", rb_getPreserveSubscriptions, 0);
+    rb_define_method(cClient, "preserve_subscriptions=", rb_setPreserveSubscriptions, 1);
+    rb_define_method(cClient, "enable_notification_buffer", rb_enableNotificationBuffer, -1);
+    rb_define_method(cClient, "disable_notification_buffer", rb_disableNotificationBuffer, 0);
+    rb_define_method(cClient, "drain_notifications", rb_drainNotifications, -1);
+    rb_define_method(cClient, "notification_buffer_stats", rb_notificationBufferStats, 0);
 
     rb_define_singleton_method(mOPCUAClient, "human_status_code", rb_get_human_UA_StatusCode, 1);
 }
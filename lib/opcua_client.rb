@@ -8,9 +8,9 @@ module OPCUAClient
     end
 
     # Create a new client and connect with it
-    def start(*args)
+    def start(*args, **options)
       client = OPCUAClient::Client.new
-      client.connect(*args)
+      client.connect(*args, **options)
       yield client
     ensure
       client.disconnect
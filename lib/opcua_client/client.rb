@@ -11,6 +11,79 @@ module OPCUAClient
       @callback_after_data_changed = block
     end
 
+    def after_data_changed_batch(&block)
+      @callback_after_data_changed_batch = block
+    end
+
+    def after_subscription_recovered(&block)
+      @callback_after_subscription_recovered = block
+    end
+
+    def after_event(&block)
+      @callback_after_event = block
+    end
+
+    def after_writes_flushed(&block)
+      @callback_after_writes_flushed = block
+    end
+
+    def after_connection_state_changed(&block)
+      @callback_after_connection_state_changed = block
+    end
+
+    def after_health_changed(&block)
+      @callback_after_health_changed = block
+    end
+
+    # Items per managed subscription, unless the server allows fewer
+    MANAGED_SUBSCRIPTION_SIZE = 1000
+
+    # Places the nodes in managed subscriptions, one set per publishing
+    # interval (rate, in milliseconds), filling those with room before
+    # creating another. Returns [subscription_ids, item_ids, statuses].
+    def subscribe(nodes, rate:, **options, &block)
+      subscriptions = (managed_subscriptions[rate] ||= {})
+      options = { sampling_interval: rate }.merge(options)
+      result = [[], [], []]
+      remaining = nodes.dup
+
+      until remaining.empty?
+        subscription_id, room = managed_subscription_with_room(subscriptions, rate)
+        batch = remaining.shift(room)
+        ids, statuses = add_monitored_items(subscription_id, batch, options, &block)
+        subscriptions[subscription_id] += ids.compact.size
+
+        result[0].concat([subscription_id] * batch.size)
+        result[1].concat(ids)
+        result[2].concat(statuses)
+      end
+
+      result
+    end
+
+    # Deletes items placed by subscribe, and their subscription once empty
+    def unsubscribe(subscription_ids, item_ids)
+      statuses = Array.new(item_ids.size)
+
+      subscription_ids.each_index.group_by { |i| subscription_ids[i] }.each do |subscription_id, indexes|
+        results = delete_monitored_items(subscription_id, item_ids.values_at(*indexes))
+        indexes.zip(results) { |i, status| statuses[i] = status }
+        release_managed_items(subscription_id, results.count(0))
+      end
+
+      statuses
+    end
+
+    alias native_delete_subscriptions delete_subscriptions
+    private :native_delete_subscriptions
+
+    # Also forgets managed subscriptions among them
+    def delete_subscriptions(ids)
+      statuses = native_delete_subscriptions(ids)
+      @managed_subscriptions&.each_value { |subscriptions| ids.each { |id| subscriptions.delete(id) } }
+      statuses
+    end
+
     def human_state
       state = self.state
 
@@ -24,5 +97,45 @@ module OPCUAClient
       else 'UNKNOWN_STATE'
       end
     end
+
+    private
+
+    # Subscription id => item count, per rate. Recovery reports the new ids
+    # of recreated subscriptions through the internal callback.
+    def managed_subscriptions
+      @managed_subscriptions ||= begin
+        @callback_managed_subscription_recovered = lambda do |old_id, new_id|
+          subscriptions = @managed_subscriptions.each_value.find { |rate| rate.key?(old_id) }
+          subscriptions[new_id] = subscriptions.delete(old_id) if subscriptions
+        end
+        {}
+      end
+    end
+
+    def managed_subscription_with_room(subscriptions, rate)
+      limit = operation_limits[:max_monitored_items_per_subscription]
+      limit = MANAGED_SUBSCRIPTION_SIZE if limit.zero? || limit > MANAGED_SUBSCRIPTION_SIZE
+
+      subscription_id, count = subscriptions.select { |_id, items| items < limit }.max_by { |_id, items| items }
+      unless subscription_id
+        subscription_id = create_subscription(publishing_interval: rate)
+        raise OPCUAClient::Error, "cannot create a subscription for rate #{rate}" unless subscription_id
+
+        count = subscriptions[subscription_id] = 0
+      end
+
+      [subscription_id, limit - count]
+    end
+
+    def release_managed_items(subscription_id, released)
+      subscriptions = @managed_subscriptions&.each_value&.find { |rate| rate.key?(subscription_id) }
+      return unless subscriptions
+
+      subscriptions[subscription_id] -= released
+      return if subscriptions[subscription_id].positive?
+
+      subscriptions.delete(subscription_id)
+      delete_subscriptions([subscription_id])
+    end
   end
 end
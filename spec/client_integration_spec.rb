@@ -322,6 +322,501 @@ RSpec.describe 'OPC UA Client Integration Tests', type: :feature do
     end
   end
 
+  describe '#flush_writes' do
+    before { connected_client }
+    after  { reset_float_server_values }
+
+    it 'sends the last queued value per node' do
+      client.enqueue_write(namespace_id, 'float_zero', 1.5, :float)
+      client.enqueue_write(namespace_id, 'float_zero', 2.5, :float)
+      client.flush_writes
+      expect(client.read_float(namespace_id, 'float_zero')).to be_within(0.001).of(2.5)
+    end
+
+    it 'returns the status for each node' do
+      client.enqueue_write(namespace_id, 'float_zero', 1.5, :float)
+      client.enqueue_write(namespace_id, 'missing_node', 1.5, :float)
+      results = client.flush_writes
+      expect(results.map(&:last)).to eq([0, 0x80340000])
+    end
+  end
+
+  describe '#enable_write_dedup' do
+    before do
+      connected_client
+      client.enable_write_dedup(0.01)
+    end
+
+    after { reset_float_server_values }
+
+    it 'skips writes equal to the last written value' do
+      2.times { client.write_float(namespace_id, 'float_zero', 4.0) }
+      expect(client.write_dedup_stats).to include(hits: 1, misses: 1, nodes: 1)
+    end
+
+    it 'skips writes within the deadband' do
+      client.write_float(namespace_id, 'float_zero', 4.0)
+      client.write_float(namespace_id, 'float_zero', 4.005)
+      expect(client.read_float(namespace_id, 'float_zero')).to be_within(0.0001).of(4.0)
+    end
+
+    it 'skips writes of the value a monitored item reported' do
+      subscription_id = client.create_subscription
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_pi']])
+      5.times { client.run_mon_cycle }
+      client.write_float(namespace_id, 'float_pi', client.read_float(namespace_id, 'float_pi'))
+      expect(client.write_dedup_stats).to include(hits: 1, misses: 0, nodes: 1)
+    end
+  end
+
+  describe '#multi_write_data_values' do
+    before { connected_client }
+    after  { reset_float_server_values }
+
+    it 'writes timestamped points in chunks' do
+      client.write_chunk_size = 2
+      stamps = [Time.now - 2, Time.now - 1, Time.now]
+      statuses = client.multi_write_data_values(namespace_id, 'float_zero', :float, [1.0, 2.0, 3.0], stamps)
+      expect(statuses.unpack('L<*')).to eq([0, 0, 0])
+      expect(client.read_float(namespace_id, 'float_zero')).to eq(3.0)
+    end
+
+    it 'accepts packed values and timestamps' do
+      now = Process.clock_gettime(Process::CLOCK_REALTIME, :nanosecond)
+      values = [1.5, 2.5].pack('e*')
+      stamps = [now - 1_000_000, now].pack('q<*')
+      statuses = client.multi_write_data_values(namespace_id, %w[float_zero float_pi], :float, values, stamps)
+      expect(statuses.unpack('L<*')).to eq([0, 0])
+      expect(client.read_float(namespace_id, 'float_pi')).to eq(2.5)
+    end
+
+    it 'raises on mismatched lengths' do
+      expect { client.multi_write_data_values(namespace_id, 'float_zero', :float, [1.0, 2.0], [Time.now]) }
+        .to raise_error(OPCUAClient::Error)
+    end
+  end
+
+  describe '#create_subscription' do
+    before { connected_client }
+
+    it 'returns the id and keeps the revised parameters in the stats' do
+      subscription_id = client.create_subscription(publishing_interval: 250.0, keepalive_count: 5, lifetime_count: 30,
+                                                   max_notifications_per_publish: 100, priority: 2)
+      expect(subscription_id).to be_a(Integer)
+      expect(client.subscription_stats[subscription_id][:publishing_interval]).to be >= 250.0
+    end
+
+    it 'rejects unknown options' do
+      expect { client.create_subscription(interval: 1) }.to raise_error(ArgumentError)
+    end
+
+    it 'delivers epoch nanosecond timestamps when asked' do
+      times = []
+      client.after_data_changed { |_sub, _mon, server_time, _source_time, _value| times << server_time }
+      subscription_id = client.create_subscription(timestamps: :epoch_ns)
+      client.add_monitored_item(subscription_id, namespace_id, 'float_zero')
+
+      5.times { client.run_mon_cycle }
+
+      expect(times.first).to be_a(Integer)
+      expect(times.first).to be_within(60 * 10**9).of(Process.clock_gettime(Process::CLOCK_REALTIME, :nanosecond))
+    end
+  end
+
+  describe '#after_data_changed_batch' do
+    before { connected_client }
+    after  { reset_float_server_values }
+
+    it 'delivers notifications as columns once per cycle' do
+      batches = []
+      client.after_data_changed_batch { |*columns| batches << columns }
+      subscription_id = client.create_subscription
+      ids, = client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']])
+
+      5.times { client.run_mon_cycle }
+
+      _subscription_ids, monitor_ids, _server_times, _source_times, values, statuses = batches.first
+      expect(monitor_ids).to match_array(ids)
+      expect(values.size).to eq(2)
+      expect(statuses).to eq([0, 0])
+    end
+
+    it 'replaces the per-value callback' do
+      single = []
+      client.after_data_changed { |*args| single << args }
+      client.after_data_changed_batch { |*| nil }
+      client.add_monitored_items(client.create_subscription, [[namespace_id, 'float_zero']])
+
+      5.times { client.run_mon_cycle }
+
+      expect(single).to be_empty
+    end
+  end
+
+  describe '#subscription_stats' do
+    before { connected_client }
+
+    it 'counts notifications per subscription' do
+      subscription_id = client.create_subscription
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']])
+
+      5.times { client.run_mon_cycle }
+
+      stats = client.subscription_stats.fetch(subscription_id)
+      expect(stats).to include(notifications: 2, overflows: 0, inactivity: 0)
+      expect(stats[:notification_rate]).to be > 0
+      expect(client.subscription_stats.fetch(subscription_id)[:notification_rate]).to eq(0.0)
+    end
+
+    it 'forgets deleted subscriptions' do
+      subscription_id = client.create_subscription
+      expect(client.subscription_stats.fetch(subscription_id)[:publishing_interval]).to be > 0
+
+      client.delete_subscriptions([subscription_id])
+      expect(client.subscription_stats).to be_empty
+    end
+  end
+
+  describe '#enable_notification_buffer' do
+    before { connected_client }
+
+    it 'buffers notifications and accounts for drops' do
+      client.enable_notification_buffer(1, :drop_newest)
+      client.after_data_changed { |*| raise 'notifications go to the buffer' }
+      subscription_id = client.create_subscription
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']])
+
+      5.times { client.run_mon_cycle }
+
+      expect(client.notification_buffer_stats).to include(depth: 1, high_water: 1, dropped: 1)
+      _subscription_ids, monitor_ids, = client.drain_notifications
+      expect(monitor_ids.size).to eq(1)
+      expect(client.notification_buffer_stats[:depth]).to eq(0)
+    end
+  end
+
+  describe '#preserve_subscriptions' do
+    let(:recovered) { [] }
+
+    before do
+      client.preserve_subscriptions = true
+      client.after_subscription_recovered { |*args| recovered << args }
+      connected_client
+    end
+
+    it 'recreates recorded subscriptions after the server restarts' do
+      subscription_id = client.create_subscription
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']])
+      stop_server
+      start_server
+      client.run_mon_cycle
+      client.connect(endpoint_url)
+
+      old_id, _new_id, old_item_ids, new_item_ids = recovered.first
+      expect(old_id).to eq(subscription_id)
+      expect(old_item_ids.size).to eq(2)
+      expect(new_item_ids).to all(be_a(Integer))
+    end
+
+    it 'reports the status of every recreated item' do
+      subscription_id = client.create_subscription
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']])
+      stop_server
+      start_server
+      client.run_mon_cycle
+      client.connect(endpoint_url)
+
+      _old_id, _new_id, _old_item_ids, _new_item_ids, statuses = recovered.first
+      expect(statuses).to eq([0, 0])
+    end
+
+    it 'recovers every subscription before a raising block runs' do
+      client.after_subscription_recovered { raise 'recovery block failed' }
+      2.times { client.create_subscription }
+      stop_server
+      start_server
+      expect do
+        client.run_mon_cycle
+        client.connect(endpoint_url)
+      end.to raise_error(RuntimeError, 'recovery block failed')
+      expect(client.subscription_stats.size).to eq(2)
+    end
+
+    it 'recreates event items' do
+      subscription_id = client.create_subscription
+      event_id = client.add_event_monitored_item(subscription_id, 0, 2253, select: %w[Message Severity])
+      stop_server
+      start_server
+      client.run_mon_cycle
+      client.connect(endpoint_url)
+
+      _old_id, _new_id, old_item_ids, _new_item_ids, statuses = recovered.first
+      expect(old_item_ids).to eq([event_id])
+      expect(statuses).to eq([0])
+    end
+  end
+
+  describe 'fast connect' do
+    after { OPCUAClient::Client.clear_endpoint_cache }
+
+    it 'connects again from the cached endpoint' do
+      client.connect(endpoint_url, cached_endpoint: true)
+      client.disconnect
+      client.connect(endpoint_url, cached_endpoint: true)
+      expect(client.state).to eq(OPCUAClient::UA_SESSIONSTATE_ACTIVATED)
+    end
+
+    it 'activates the session of another client' do
+      client.connect(endpoint_url)
+      other = OPCUAClient::Client.new
+      other.connect(endpoint_url, session: client.session_credentials)
+      expect(other.session_credentials).to eq(client.session_credentials)
+    ensure
+      other&.disconnect
+    end
+  end
+
+  describe '#enable_auto_reconnect' do
+    let(:states) { [] }
+
+    before do
+      client.enable_auto_reconnect(initial_delay: 0.1, max_delay: 0.5)
+      client.after_connection_state_changed { |state, _info| states << state }
+      connected_client
+    end
+
+    it 'reconnects after the server restarts' do
+      stop_server
+      client.run_mon_cycle
+      start_server
+      20.times { client.run_mon_cycle unless client.connection_state == :connected }
+
+      expect(states).to include(:disconnected, :reconnecting)
+      expect(client.connection_state).to eq(:connected)
+    end
+
+    it 'fails attempts without raising while the server is down' do
+      stop_server
+      15.times { client.run_mon_cycle }
+      start_server
+
+      expect(states.count(:reconnecting)).to be >= 2
+      expect(client.connection_state).not_to eq(:connected)
+    end
+  end
+
+  describe '#enable_health_monitor' do
+    let(:events) { [] }
+
+    before do
+      client.enable_health_monitor(interval: 0.1, failure_threshold: 1)
+      client.after_health_changed { |event, _info| events << event }
+      connected_client
+      3.times { client.run_mon_cycle }
+    end
+
+    it 'probes the idle session' do
+      expect(client.health_stats).to include(alive: true, failures: 0)
+      expect(client.health_stats[:rtt][:count]).to be >= 1
+    end
+
+    it 'counts failed probes while the server is down' do
+      stop_server
+      5.times { client.run_mon_cycle }
+      start_server
+
+      expect(client.health_stats[:failures]).to be >= 1
+      expect(events).to include(:down)
+    end
+  end
+
+  describe 'bulk monitored item changes' do
+    before { connected_client }
+
+    let(:subscription_id) { client.create_subscription }
+    let(:item_ids) do
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']]).first
+    end
+
+    it 'modifies items' do
+      options = { sampling_interval: 1000, queue_size: 5, discard_oldest: true }
+      expect(client.modify_monitored_items(subscription_id, item_ids, **options)).to eq([0, 0])
+    end
+
+    it 'requires complete parameters for items that are not recorded' do
+      expect { client.modify_monitored_items(subscription_id, item_ids, queue_size: 5) }.to raise_error(ArgumentError)
+    end
+
+    it 'modifies recorded items from their parameters' do
+      client.preserve_subscriptions = true
+      ids = client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero']]).first
+      expect(client.modify_monitored_items(subscription_id, ids, queue_size: 5)).to eq([0])
+    end
+
+    it 'sets the monitoring mode' do
+      expect(client.set_monitoring_mode(subscription_id, item_ids, :disabled)).to eq([0, 0])
+    end
+
+    it 'deletes items and reports unknown ids' do
+      expect(client.delete_monitored_items(subscription_id, item_ids + [999_999]).take(2)).to eq([0, 0])
+    end
+
+    it 'deletes subscriptions' do
+      expect(client.delete_subscriptions([subscription_id])).to eq([0])
+    end
+  end
+
+  describe '#measure_latency' do
+    before { connected_client }
+
+    it 'records the latency of delivered notifications' do
+      client.measure_latency = true
+      client.after_data_changed { |*| nil }
+      expect(client.estimate_clock_offset[:round_trip]).to be >= 0
+      subscription_id = client.create_subscription
+      client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']])
+
+      5.times { client.run_mon_cycle }
+
+      expect(client.latency_histograms[:receipt_to_callback]).to include(count: 2)
+    end
+  end
+
+  describe '#stale_items' do
+    before { connected_client }
+
+    it 'reports items silent for longer than expected' do
+      subscription_id = client.create_subscription(publishing_interval: 100, keepalive_count: 1)
+      ids, = client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero']],
+                                        sampling_interval: 100, tag: :zero)
+      client.run_mon_cycle
+      expect(client.stale_items[1]).to be_empty
+
+      client.set_monitoring_mode(subscription_id, ids, :disabled)
+      sleep 0.5
+      expect(client.stale_items[1..2]).to eq([ids, [:zero]])
+    end
+
+    it 'keeps counting the silence across a modify' do
+      subscription_id = client.create_subscription(publishing_interval: 100, keepalive_count: 1)
+      ids, = client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero']], sampling_interval: 100)
+      client.set_monitoring_mode(subscription_id, ids, :disabled)
+      sleep 0.5
+      client.modify_monitored_items(subscription_id, ids, sampling_interval: 50, queue_size: 1, discard_oldest: true)
+      expect(client.stale_items[1]).to eq(ids)
+    end
+  end
+
+  describe '#subscribe' do
+    before { connected_client }
+
+    it 'groups items by rate' do
+      fast, = client.subscribe([[namespace_id, 'float_zero'], [namespace_id, 'float_pi']], rate: 100)
+      slow, = client.subscribe([[namespace_id, 'float_negative']], rate: 5000)
+      expect(fast.uniq.size).to eq(1)
+      expect(slow.first).not_to eq(fast.first)
+    end
+
+    it 'deletes a managed subscription once its items are gone' do
+      subscription_ids, item_ids, = client.subscribe([[namespace_id, 'float_zero']], rate: 100)
+      expect(client.unsubscribe(subscription_ids, item_ids)).to eq([0])
+      expect(client.subscription_stats).not_to have_key(subscription_ids.first)
+    end
+
+    it 'forgets managed subscriptions deleted directly' do
+      first, = client.subscribe([[namespace_id, 'float_zero']], rate: 100)
+      client.delete_subscriptions(first.uniq)
+      second, = client.subscribe([[namespace_id, 'float_pi']], rate: 100)
+      expect(second.first).not_to eq(first.first)
+    end
+  end
+
+  describe '#set_triggering' do
+    before { connected_client }
+
+    it 'reports sampled items when the triggering item reports' do
+      values = []
+      subscription_id = client.create_subscription
+      trigger_id = client.add_monitored_item(subscription_id, namespace_id, 'float_zero')
+      sampled_ids, = client.add_monitored_items(subscription_id, [[namespace_id, 'float_pi']],
+                                                monitoring_mode: :sampling) { |value, *| values << value }
+
+      expect(client.set_triggering(subscription_id, trigger_id, sampled_ids)).to eq([[0], []])
+      5.times { client.run_mon_cycle }
+      expect(values.size).to eq(1)
+
+      expect(client.set_triggering(subscription_id, trigger_id, [], sampled_ids)).to eq([[], [0]])
+    end
+  end
+
+  describe '#add_event_monitored_item' do
+    before { connected_client }
+
+    it 'monitors events of the Server object' do
+      subscription_id = client.create_subscription
+      id = client.add_event_monitored_item(subscription_id, 0, 2253,
+                                           select: %w[EventId Severity Message ActiveState/Id],
+                                           where: { of_type: 2041, min_severity: 1 })
+      expect(id).to be_a(Integer)
+    end
+
+    it 'requires select clauses' do
+      expect { client.add_event_monitored_item(1, 0, 2253) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe '#add_monitored_items' do
+    before { connected_client }
+
+    it 'creates all items in one call' do
+      subscription_id = client.create_subscription
+      nodes = [[namespace_id, 'float_zero'], [namespace_id, 'float_pi']]
+      ids, statuses = client.add_monitored_items(subscription_id, nodes)
+      expect(statuses).to eq([0, 0])
+      expect(ids).to all(be_a(Integer))
+    end
+
+    it 'accepts sampling and deadband options' do
+      subscription_id = client.create_subscription
+      options = { sampling_interval: 100, queue_size: 4, discard_oldest: false, trigger: :value,
+                  absolute_deadband: 0.5 }
+      _ids, statuses = client.add_monitored_items(subscription_id, [[namespace_id, 'float_zero']], options)
+      expect(statuses).to eq([0])
+      expect(options).to include(:sampling_interval)
+    end
+
+    it 'rejects both deadband kinds' do
+      subscription_id = client.create_subscription
+      expect do
+        client.add_monitored_item(subscription_id, namespace_id, 'float_zero',
+                                  absolute_deadband: 1, percent_deadband: 1)
+      end.to raise_error(ArgumentError)
+    end
+
+    it 'dispatches to the block with the item tag' do
+      received = []
+      client.after_data_changed { |*| raise 'handled by the item block' }
+      subscription_id = client.create_subscription
+      nodes = [[namespace_id, 'float_zero', :zero], [namespace_id, 'float_pi', :pi]]
+      client.add_monitored_items(subscription_id, nodes) do |value, _src, _srv, tag|
+        received << [tag, value]
+      end
+
+      GC.start
+      5.times { client.run_mon_cycle }
+
+      expect(received.map(&:first)).to contain_exactly(:zero, :pi)
+    end
+
+    it 'reports failures per item' do
+      subscription_id = client.create_subscription
+      nodes = [[namespace_id, 'float_zero'], [namespace_id, 'missing']]
+      ids, statuses = client.add_monitored_items(subscription_id, nodes)
+      expect(ids[1]).to be_nil
+      expect(statuses[1]).not_to eq(0)
+    end
+  end
+
   context 'with Double operations' do
     before { connected_client }
 
@@ -463,6 +958,23 @@ RSpec.describe 'OPC UA Client Integration Tests', type: :feature do
       end
     end
 
+    describe 'packed array writes' do
+      it 'writes an int32 array from a packed String' do
+        client.write_int32_array(namespace_id, 'int32_array', [7, -8, 9].pack('l<*'))
+        expect(client.read_int32_array(namespace_id, 'int32_array')).to eq([7, -8, 9])
+      end
+
+      it 'writes a double array from a packed String' do
+        client.write_double_array(namespace_id, 'double_array', [0.5, 1.5].pack('E*'))
+        expect(client.read_double_array(namespace_id, 'double_array')).to eq([0.5, 1.5])
+      end
+
+      it 'raises if the packed size does not match the element size' do
+        expect { client.write_int32_array(namespace_id, 'int32_array', "\x01\x02\x03") }
+          .to raise_error OPCUAClient::Error, /multiple of 4/
+      end
+    end
+
     it 'writes a float array' do
       new_value = [5.5, 6.6, 7.7, 8.8]
       client.write_float_array(namespace_id, 'float_array', new_value)
@@ -22,4 +22,80 @@ RSpec.describe OPCUAClient::Client do
     # state = new_client(connect: false).state
     expect(state).to eq(0)
   end
+
+  it 'starts with empty request arena stats' do
+    stats = described_class.new.request_arena_stats
+    expect(stats).to eq(requests: 0, allocations: 0, blocks: 0, bytes: 0)
+  end
+
+  it 'releases the request arena when building a request raises' do
+    client = described_class.new
+    expect { client.multi_read(5, ['uint32a', 1]) }.to raise_error(OPCUAClient::Error)
+    expect(client.request_arena_stats[:requests]).to eq(1)
+  end
+
+  it 'coalesces queued writes to the same node' do
+    client = described_class.new
+    client.enqueue_write(5, 'float_zero', 1.0, :float)
+    client.enqueue_write(5, 'float_zero', 2.0, :float)
+    client.enqueue_write(5, 'float_pi', 3.0, :float)
+    expect(client.write_queue_stats).to include(pending: 2, enqueued: 3, coalesced: 1)
+  end
+
+  it 'selects the timestamp representation' do
+    client = described_class.new
+    expect(client.timestamps).to eq(:time)
+    client.timestamps = :epoch_ns
+    expect(client.timestamps).to eq(:epoch_ns)
+    expect { client.timestamps = :iso8601 }.to raise_error(OPCUAClient::Error)
+  end
+
+  it 'configures the notification buffer' do
+    client = described_class.new
+    client.enable_notification_buffer(16, :coalesce)
+    expect(client.notification_buffer_stats).to include(enabled: true, capacity: 16, overflow: :coalesce, depth: 0)
+    expect(client.drain_notifications).to eq([[], [], [], [], [], []])
+    client.disable_notification_buffer
+    expect(client.notification_buffer_stats).to include(enabled: false)
+  end
+
+  it 'configures the publish pipeline' do
+    client = described_class.new
+    client.outstanding_publish_requests = 20
+    client.queue_size = 10
+    expect([client.outstanding_publish_requests, client.queue_size]).to eq([20, 10])
+    expect { client.outstanding_publish_requests = 0 }.to raise_error(ArgumentError)
+  end
+
+  it 'starts with empty latency histograms' do
+    histograms = described_class.new.latency_histograms
+    expect(histograms[:server_to_receipt]).to include(count: 0, mean: nil)
+    expect(histograms[:clock_offset]).to be_nil
+  end
+
+  it 'starts without stale items' do
+    expect(described_class.new.stale_items).to eq([[], [], [], []])
+  end
+
+  it 'validates the reconnect backoff' do
+    client = described_class.new
+    expect(client.connection_state).to eq(:disconnected)
+    expect { client.enable_auto_reconnect(initial_delay: 2, max_delay: 1) }.to raise_error(ArgumentError)
+  end
+
+  it 'validates the health monitor thresholds' do
+    client = described_class.new
+    expect(client.health_stats).to include(enabled: false, alive: nil, probes: 0)
+    expect { client.enable_health_monitor(failure_threshold: 0) }.to raise_error(ArgumentError)
+  end
+
+  it 'takes timeouts and buffer sizes' do
+    expect { described_class.new(timeout: 2000, recv_buffer_size: 1 << 20, max_chunk_count: 0) }.not_to raise_error
+    expect { described_class.new(timeout: 0) }.to raise_error(ArgumentError)
+    expect { described_class.new(send_buffer_size: 1024) }.to raise_error(ArgumentError)
+  end
+
+  it 'starts without subscription stats' do
+    expect(described_class.new.subscription_stats).to eq({})
+  end
 end